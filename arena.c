@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * arena.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * A simple bump allocator.  Everything that belongs to one snapshot of
+ * the device tree comes out of the snapshot's arena, and nothing is ever
+ * freed on its own: the whole arena goes away at once with the snapshot.
+ */
+
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+#define ARENA_ALIGN		(sizeof(gpointer) * 2)
+
+struct chunk {
+	struct chunk	*next;
+	gsize		size;
+	gsize		used;
+	/* the memory handed out follows right after, suitably aligned */
+};
+
+#define CHUNK_HEADER_SIZE	((sizeof(struct chunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct arena {
+	GMutex		lock;		/* scans fill in a snapshot from many threads */
+	struct chunk	*chunks;	/* the one being used up is first */
+	gsize		total;
+};
+
+struct arena *arena_new(void)
+{
+	struct arena *arena;
+
+	arena = g_malloc0(sizeof(*arena));
+	g_mutex_init(&arena->lock);
+
+	return arena;
+}
+
+void arena_free(struct arena *arena)
+{
+	struct chunk *chunk;
+	struct chunk *next;
+
+	if (arena == NULL)
+		return;
+
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		g_free(chunk);
+	}
+
+	g_mutex_clear(&arena->lock);
+	g_free(arena);
+}
+
+static struct chunk *chunk_new(gsize size)
+{
+	struct chunk *chunk;
+
+	chunk = g_malloc(CHUNK_HEADER_SIZE + size);
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+gpointer arena_alloc0(struct arena *arena, gsize size)
+{
+	struct chunk *chunk;
+	gpointer mem;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	g_mutex_lock(&arena->lock);
+
+	chunk = arena->chunks;
+	if (chunk == NULL || chunk->used + size > chunk->size) {
+		if (size > ARENA_CHUNK_SIZE / 4) {
+			/*
+			 * Big ones get a chunk of their own, behind the
+			 * current one, so its free space is not wasted.
+			 */
+			chunk = chunk_new(size);
+			if (arena->chunks) {
+				chunk->next = arena->chunks->next;
+				arena->chunks->next = chunk;
+			} else {
+				arena->chunks = chunk;
+			}
+		} else {
+			chunk = chunk_new(ARENA_CHUNK_SIZE);
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+		arena->total += chunk->size;
+	}
+
+	mem = (char *)chunk + CHUNK_HEADER_SIZE + chunk->used;
+	chunk->used += size;
+
+	g_mutex_unlock(&arena->lock);
+
+	memset(mem, 0x00, size);
+	return mem;
+}
+
+gpointer arena_memdup(struct arena *arena, gconstpointer mem, gsize size)
+{
+	gpointer copy;
+
+	if (mem == NULL)
+		return NULL;
+
+	copy = arena_alloc0(arena, size);
+	memcpy(copy, mem, size);
+
+	return copy;
+}
+
+gchar *arena_strdup(struct arena *arena, const gchar *string)
+{
+	if (string == NULL)
+		return NULL;
+
+	return arena_memdup(arena, string, strlen(string) + 1);
+}
+
+/* how much memory the arena holds on to */
+gsize arena_size(struct arena *arena)
+{
+	gsize total;
+
+	g_mutex_lock(&arena->lock);
+	total = arena->total;
+	g_mutex_unlock(&arena->lock);
+
+	return total;
+}
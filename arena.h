@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * arena.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, greg@kroah.com
+ */
+#ifndef __ARENA_H
+#define __ARENA_H
+
+struct arena;
+
+struct arena *arena_new(void);
+void arena_free(struct arena *arena);
+gpointer arena_alloc0(struct arena *arena, gsize size);
+gpointer arena_memdup(struct arena *arena, gconstpointer mem, gsize size);
+gchar *arena_strdup(struct arena *arena, const gchar *string);
+gsize arena_size(struct arena *arena);
+
+#endif	/* __ARENA_H */
@@ -0,0 +1,631 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * gensysfs.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Write a made up, but real looking, USB device tree in the same layout
+ * as sysfs, so the scan can be tested and timed on any number of devices
+ * without having the hardware for it:
+ *
+ *	gensysfs [-n devices] [-b buses] [-f fanout] [-d depth]
+ *		 [-i interfaces] [-e endpoints] [-s seed] DIR
+ *	usbview --sysfs-root=DIR
+ *
+ * Hubs get filled up breadth first, half of the ports of every hub are
+ * hubs again until the tree is "depth" tiers deep (the root hub is the
+ * first tier, USB allows seven), and the rest of the ports get a mix of
+ * keyboards, mice, flash drives, webcams, serial adapters, devices
+ * without a driver, and composite devices with lots of interfaces.  A
+ * bus has no more than 127 devices, just like the real thing, so buses
+ * are added for as long as more devices are needed.
+ */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MAX_DEVICES_PER_BUS	127
+#define MAX_DEPTH		7
+#define MAX_ENDPOINTS		30	/* 15 in and 15 out, besides endpoint 0 */
+#define MAX_INTERFACES		32
+
+struct endpoint_kind {
+	unsigned char	address;
+	unsigned char	attributes;	/* 1 isoc, 2 bulk, 3 interrupt */
+	unsigned short	maxPacket;
+	unsigned char	interval;
+};
+
+struct interface_kind {
+	unsigned char	class;
+	unsigned char	subClass;
+	unsigned char	protocol;
+	unsigned char	alternates;	/* more than one, and alt 0 has no endpoints */
+	const char	*driver;	/* NULL for none */
+	unsigned char	endpointCount;
+	struct endpoint_kind endpoint[4];
+};
+
+struct device_kind {
+	const char	*manufacturer;
+	const char	*product;
+	unsigned short	vendorId;
+	unsigned short	productId;
+	const char	*speed;
+	unsigned char	class;
+	unsigned char	protocol;
+	int		hasSerial;
+	int		interfaceCount;
+	const struct interface_kind *interface;
+};
+
+static const struct interface_kind hubInterface[] = {
+	{ 0x09, 0x00, 0x00, 1, "hub", 1, { { 0x81, 3, 1, 12 } } },
+};
+
+static const struct interface_kind keyboardInterfaces[] = {
+	{ 0x03, 0x01, 0x01, 1, "usbhid", 1, { { 0x81, 3, 8, 10 } } },
+	{ 0x03, 0x00, 0x00, 1, "usbhid", 1, { { 0x82, 3, 8, 10 } } },
+};
+
+static const struct interface_kind receiverInterfaces[] = {
+	{ 0x03, 0x01, 0x01, 1, "usbhid", 1, { { 0x81, 3, 8, 8 } } },
+	{ 0x03, 0x01, 0x02, 1, "usbhid", 1, { { 0x82, 3, 8, 2 } } },
+	{ 0x03, 0x00, 0x00, 1, "usbhid", 1, { { 0x83, 3, 32, 2 } } },
+};
+
+static const struct interface_kind storageInterfaces[] = {
+	{ 0x08, 0x06, 0x50, 1, "usb-storage", 2, { { 0x81, 2, 512, 0 }, { 0x02, 2, 512, 0 } } },
+};
+
+static const struct interface_kind webcamInterfaces[] = {
+	{ 0x0e, 0x01, 0x00, 1, "uvcvideo", 1, { { 0x87, 3, 16, 8 } } },
+	{ 0x0e, 0x02, 0x00, 11, "uvcvideo", 1, { { 0x81, 5, 0x1400, 1 } } },
+	{ 0x01, 0x01, 0x00, 1, "snd-usb-audio", 0, { } },
+	{ 0x01, 0x02, 0x00, 2, "snd-usb-audio", 1, { { 0x86, 5, 100, 4 } } },
+};
+
+static const struct interface_kind serialInterfaces[] = {
+	{ 0x02, 0x02, 0x01, 1, "cdc_acm", 1, { { 0x82, 3, 8, 255 } } },
+	{ 0x0a, 0x00, 0x00, 1, "cdc_acm", 2, { { 0x04, 2, 64, 0 }, { 0x83, 2, 64, 0 } } },
+};
+
+static const struct interface_kind widgetInterfaces[] = {
+	{ 0xff, 0x00, 0x00, 1, NULL, 2, { { 0x81, 2, 512, 0 }, { 0x01, 2, 512, 0 } } },
+};
+
+static const struct device_kind rootHubKind = {
+	"Linux 6.12.0 xhci-hcd", "xHCI Host Controller", 0x1d6b, 0x0002,
+	"480", 0x09, 0x01, 1, 1, hubInterface
+};
+
+static const struct device_kind hubKind = {
+	"GenesysLogic", "USB2.1 Hub", 0x05e3, 0x0610,
+	"480", 0x09, 0x02, 0, 1, hubInterface
+};
+
+/* the composite device gets its interfaces made up from the options */
+#define COMPOSITE_KIND	6
+
+static struct device_kind leafKinds[] = {
+	{ "Logitech", "USB Keyboard", 0x046d, 0xc31c, "1.5", 0x00, 0x00, 0, 2, keyboardInterfaces },
+	{ "Logitech", "USB Receiver", 0x046d, 0xc52b, "12", 0x00, 0x00, 0, 3, receiverInterfaces },
+	{ "SanDisk", " SanDisk 3.2Gen1", 0x0781, 0x5581, "480", 0x00, 0x00, 1, 1, storageInterfaces },
+	{ NULL, "Webcam C270", 0x046d, 0x0825, "480", 0xef, 0x01, 1, 4, webcamInterfaces },
+	{ "Arduino (www.arduino.cc)", "Arduino Uno", 0x2341, 0x0043, "12", 0x02, 0x00, 1, 2, serialInterfaces },
+	{ "Acme", "Widget", 0x1234, 0x5678, "480", 0x00, 0x00, 0, 1, widgetInterfaces },
+	{ "Acme", "Composite Test Device", 0x1234, 0x5679, "480", 0xef, 0x01, 1, 0, NULL },
+};
+
+#define LEAF_KINDS	(sizeof(leafKinds) / sizeof(leafKinds[0]))
+
+/* a hub that still has ports to fill */
+struct hub {
+	char		*path;		/* of its directory, from the root */
+	char		*name;		/* "usb1", "1-2", "1-2.3", ... */
+	int		bus;
+	int		tier;
+};
+
+struct generator {
+	const char	*root;
+	int		devices;	/* how many to make, root hubs and hubs too */
+	int		made;
+	int		buses;
+	int		fanout;
+	int		depth;
+	unsigned int	seed;
+	int		devnum[256];	/* the last device number used on each bus */
+
+	struct hub	*queue;
+	int		queueHead;
+	int		queueTail;
+	int		queueSize;
+};
+
+static void die(const char *what, const char *path)
+{
+	fprintf(stderr, "gensysfs: %s %s: %s\n", what, path, strerror(errno));
+	exit(1);
+}
+
+static void make_dir(struct generator *gen, const char *path)
+{
+	char full[PATH_MAX];
+
+	snprintf(full, sizeof(full), "%s/%s", gen->root, path);
+	if (mkdir(full, 0755) && errno != EEXIST)
+		die("can not create", full);
+}
+
+static void write_file(struct generator *gen, const char *dir, const char *name,
+		       const void *data, size_t length)
+{
+	char full[PATH_MAX];
+	FILE *f;
+
+	snprintf(full, sizeof(full), "%s/%s/%s", gen->root, dir, name);
+	f = fopen(full, "w");
+	if (f == NULL)
+		die("can not create", full);
+	if (length && fwrite(data, length, 1, f) != 1)
+		die("can not write", full);
+	if (fclose(f))
+		die("can not write", full);
+}
+
+/* sysfs attributes are a single line of text */
+static void write_attr(struct generator *gen, const char *dir, const char *name,
+		       const char *format, ...) __attribute__((format(printf, 4, 5)));
+
+static void write_attr(struct generator *gen, const char *dir, const char *name,
+		       const char *format, ...)
+{
+	char value[256];
+	va_list args;
+	int length;
+
+	va_start(args, format);
+	length = vsnprintf(value, sizeof(value) - 1, format, args);
+	va_end(args);
+
+	value[length++] = '\n';
+	write_file(gen, dir, name, value, length);
+}
+
+/* "target" and "name" are both from the root */
+static void make_link(struct generator *gen, const char *target, const char *name)
+{
+	char full[PATH_MAX];
+	char link[PATH_MAX];
+	const char *slash;
+	int up = 0;
+
+	/* go up to the root from the directory the link is in */
+	for (slash = strchr(name, '/'); slash; slash = strchr(slash + 1, '/'))
+		++up;
+	link[0] = 0x00;
+	while (up--)
+		strcat(link, "../");
+	strcat(link, target);
+
+	snprintf(full, sizeof(full), "%s/%s", gen->root, name);
+	if (symlink(link, full))
+		die("can not create", full);
+}
+
+/* the descriptors file, in the order the kernel has it */
+struct descriptors {
+	unsigned char	data[4096];
+	size_t		length;
+};
+
+static unsigned char *desc_add(struct descriptors *desc, size_t length)
+{
+	unsigned char *d = &desc->data[desc->length];
+
+	desc->length += length;
+	return d;
+}
+
+static void desc_le16(unsigned char *d, unsigned short value)
+{
+	d[0] = value & 0xff;
+	d[1] = value >> 8;
+}
+
+static void write_endpoint(struct generator *gen, const char *dir,
+			   const struct endpoint_kind *ep, unsigned short maxPacket)
+{
+	static const char * const types[] = { "Control", "Isoc", "Bulk", "Interrupt" };
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/ep_%02x", dir, ep->address);
+	make_dir(gen, path);
+	write_attr(gen, path, "bEndpointAddress", "%02x", ep->address);
+	write_attr(gen, path, "bmAttributes", "%02x", ep->attributes);
+	write_attr(gen, path, "wMaxPacketSize", "%04x", maxPacket);
+	write_attr(gen, path, "bInterval", "%02x", ep->interval);
+	write_attr(gen, path, "type", "%s", types[ep->attributes & 0x03]);
+	write_attr(gen, path, "direction", "%s", (ep->address & 0x80) ? "in" : "out");
+}
+
+static void make_interface(struct generator *gen, const char *devicePath,
+			   const char *name, int bus, int number,
+			   const struct interface_kind *intf, struct descriptors *desc)
+{
+	char ifname[64];
+	char path[PATH_MAX];
+	char link[PATH_MAX];
+	char driverLink[PATH_MAX];
+	unsigned char *d;
+	int alt;
+	int i;
+
+	/* root hubs are "1-0:1.0", everything else "1-2.3:1.0" */
+	if (strncmp(name, "usb", 3) == 0)
+		snprintf(ifname, sizeof(ifname), "%d-0:1.%d", bus, number);
+	else
+		snprintf(ifname, sizeof(ifname), "%s:1.%d", name, number);
+
+	for (alt = 0; alt < intf->alternates; ++alt) {
+		int endpoints = (intf->alternates > 1 && alt == 0) ? 0 : intf->endpointCount;
+
+		d = desc_add(desc, 9);
+		d[0] = 9;
+		d[1] = 0x04;
+		d[2] = number;
+		d[3] = alt;
+		d[4] = endpoints;
+		d[5] = intf->class;
+		d[6] = intf->subClass;
+		d[7] = intf->protocol;
+		d[8] = 0;
+		for (i = 0; i < endpoints; ++i) {
+			const struct endpoint_kind *ep = &intf->endpoint[i];
+			unsigned short maxPacket = ep->maxPacket;
+
+			/* every alternate setting gets more bandwidth */
+			if (intf->alternates > 1)
+				maxPacket = (maxPacket & 0x1800) |
+					    ((maxPacket & 0x7ff) * alt / (intf->alternates - 1));
+
+			d = desc_add(desc, 7);
+			d[0] = 7;
+			d[1] = 0x05;
+			d[2] = ep->address;
+			d[3] = ep->attributes;
+			desc_le16(&d[4], maxPacket);
+			d[6] = ep->interval;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", devicePath, ifname);
+	make_dir(gen, path);
+	write_attr(gen, path, "bInterfaceNumber", "%02x", number);
+	write_attr(gen, path, "bAlternateSetting", "%2d", 0);
+	write_attr(gen, path, "bNumEndpoints", "%02x",
+		   intf->alternates > 1 ? 0 : intf->endpointCount);
+	write_attr(gen, path, "bInterfaceClass", "%02x", intf->class);
+	write_attr(gen, path, "bInterfaceSubClass", "%02x", intf->subClass);
+	write_attr(gen, path, "bInterfaceProtocol", "%02x", intf->protocol);
+	write_attr(gen, path, "supports_autosuspend", "1");
+
+	/* only alt 0 is in use, and that one has no endpoints if there are more */
+	if (intf->alternates == 1) {
+		for (i = 0; i < intf->endpointCount; ++i)
+			write_endpoint(gen, path, &intf->endpoint[i], intf->endpoint[i].maxPacket);
+	}
+
+	if (intf->driver) {
+		snprintf(link, sizeof(link), "bus/usb/drivers/%s", intf->driver);
+		make_dir(gen, link);
+		snprintf(driverLink, sizeof(driverLink), "%s/driver", path);
+		make_link(gen, link, driverLink);
+	}
+
+	snprintf(link, sizeof(link), "bus/usb/devices/%s", strrchr(path, '/') + 1);
+	make_link(gen, path, link);
+}
+
+/* Make up the interfaces of a composite device, out of "interfaces" and "endpoints" */
+static void composite_kind(struct device_kind *kind, int interfaces, int endpoints)
+{
+	static struct interface_kind interface[MAX_INTERFACES];
+	int address = 1;
+	int i;
+	int e;
+
+	for (i = 0; i < interfaces; ++i) {
+		interface[i].class = 0xff;
+		interface[i].subClass = i;
+		interface[i].protocol = 0;
+		interface[i].alternates = 1;
+		interface[i].driver = (i % 3 == 2) ? NULL : "usbfs";
+		interface[i].endpointCount = endpoints;
+		for (e = 0; e < endpoints; ++e) {
+			struct endpoint_kind *ep = &interface[i].endpoint[e];
+
+			/* in and out alternate, until all 15 numbers are used both ways */
+			ep->address = ((address + 1) / 2) | ((address & 1) ? 0x80 : 0x00);
+			ep->attributes = (e == 0) ? 3 : 2;
+			ep->maxPacket = (e == 0) ? 64 : 512;
+			ep->interval = (e == 0) ? 4 : 0;
+			++address;
+		}
+	}
+
+	kind->interfaceCount = interfaces;
+	kind->interface = interface;
+}
+
+static void make_device(struct generator *gen, const char *parentPath,
+			const char *name, int bus, int maxChildren,
+			const struct device_kind *kind, char **pathOut)
+{
+	struct descriptors desc = { .length = 0 };
+	char path[PATH_MAX];
+	char link[PATH_MAX];
+	unsigned char *d;
+	unsigned char *config;
+	int devnum = ++gen->devnum[bus];
+	int i;
+
+	snprintf(path, sizeof(path), "%s/%s", parentPath, name);
+	make_dir(gen, path);
+
+	write_attr(gen, path, "busnum", "%d", bus);
+	write_attr(gen, path, "devnum", "%d", devnum);
+	write_attr(gen, path, "devpath", "%s",
+		   strchr(name, '-') ? strchr(name, '-') + 1 : "0");
+	write_attr(gen, path, "speed", "%s", kind->speed);
+	write_attr(gen, path, "maxchild", "%d", maxChildren);
+	write_attr(gen, path, "version", "%s", " 2.00");
+	write_attr(gen, path, "idVendor", "%04x", kind->vendorId);
+	write_attr(gen, path, "idProduct", "%04x", kind->productId);
+	write_attr(gen, path, "bcdDevice", "%04x", 0x0100);
+	write_attr(gen, path, "bDeviceClass", "%02x", kind->class);
+	write_attr(gen, path, "bDeviceSubClass", "%02x", kind->class == 0xef ? 0x02 : 0x00);
+	write_attr(gen, path, "bDeviceProtocol", "%02x", kind->protocol);
+	write_attr(gen, path, "bMaxPacketSize0", "%d", 64);
+	write_attr(gen, path, "bNumConfigurations", "%d", 1);
+	write_attr(gen, path, "bConfigurationValue", "%d", 1);
+	write_attr(gen, path, "bNumInterfaces", "%2d", kind->interfaceCount);
+	write_attr(gen, path, "bmAttributes", "%02x", 0xa0);
+	write_attr(gen, path, "bMaxPower", "%dmA", 100);
+	write_attr(gen, path, "removable", "%s", "unknown");
+	if (kind->manufacturer)
+		write_attr(gen, path, "manufacturer", "%s", kind->manufacturer);
+	write_attr(gen, path, "product", "%s", kind->product);
+	if (kind->hasSerial) {
+		if (strncmp(name, "usb", 3) == 0)
+			write_attr(gen, path, "serial", "0000:00:%02x.0", bus);
+		else
+			write_attr(gen, path, "serial", "%08X", rand_r(&gen->seed));
+	}
+
+	/* the device descriptor */
+	d = desc_add(&desc, 18);
+	d[0] = 18;
+	d[1] = 0x01;
+	desc_le16(&d[2], 0x0200);
+	d[4] = kind->class;
+	d[5] = kind->class == 0xef ? 0x02 : 0x00;
+	d[6] = kind->protocol;
+	d[7] = 64;
+	desc_le16(&d[8], kind->vendorId);
+	desc_le16(&d[10], kind->productId);
+	desc_le16(&d[12], 0x0100);
+	d[14] = kind->manufacturer ? 1 : 0;
+	d[15] = 2;
+	d[16] = kind->hasSerial ? 3 : 0;
+	d[17] = 1;
+
+	/* the configuration, with its total length filled in at the end */
+	config = desc_add(&desc, 9);
+	config[0] = 9;
+	config[1] = 0x02;
+	config[4] = kind->interfaceCount;
+	config[5] = 1;
+	config[6] = 0;
+	config[7] = 0xa0;
+	config[8] = 50;
+
+	for (i = 0; i < kind->interfaceCount; ++i)
+		make_interface(gen, path, name, bus, i, &kind->interface[i], &desc);
+
+	desc_le16(&config[2], desc.length - 18);
+	write_file(gen, path, "descriptors", desc.data, desc.length);
+
+	snprintf(link, sizeof(link), "bus/usb/devices/%s", name);
+	make_link(gen, path, link);
+
+	++gen->made;
+	if (pathOut)
+		*pathOut = strdup(path);
+}
+
+static void queue_hub(struct generator *gen, char *path, const char *name,
+		      int bus, int tier)
+{
+	struct hub *hub;
+
+	if (gen->queueTail == gen->queueSize) {
+		gen->queueSize = gen->queueSize ? gen->queueSize * 2 : 64;
+		gen->queue = realloc(gen->queue, gen->queueSize * sizeof(*gen->queue));
+		if (gen->queue == NULL)
+			die("out of memory for", "hubs");
+	}
+
+	hub = &gen->queue[gen->queueTail++];
+	hub->path = path;
+	hub->name = strdup(name);
+	hub->bus = bus;
+	hub->tier = tier;
+}
+
+static void add_bus(struct generator *gen)
+{
+	char controller[PATH_MAX];
+	char name[32];
+	char *path;
+	int bus = ++gen->buses;
+
+	if (bus >= 256) {
+		fprintf(stderr, "gensysfs: too many devices for 255 buses\n");
+		exit(1);
+	}
+
+	snprintf(controller, sizeof(controller), "devices/pci0000:00/0000:00:%02x.0", bus);
+	make_dir(gen, controller);
+
+	snprintf(name, sizeof(name), "usb%d", bus);
+	make_device(gen, controller, name, bus, gen->fanout, &rootHubKind, &path);
+	queue_hub(gen, path, name, bus, 1);
+}
+
+/* Fill up all of the ports of a hub, or as many as there are devices left to make */
+static void fill_hub(struct generator *gen, const struct hub *hub)
+{
+	const struct device_kind *kind;
+	char name[64];
+	char *path;
+	int hubs = (gen->fanout + 1) / 2;
+	int port;
+
+	for (port = 1; port <= gen->fanout; ++port) {
+		if (gen->made >= gen->devices ||
+		    gen->devnum[hub->bus] >= MAX_DEVICES_PER_BUS)
+			return;
+
+		if (hub->tier == 1)
+			snprintf(name, sizeof(name), "%d-%d", hub->bus, port);
+		else
+			snprintf(name, sizeof(name), "%s.%d", hub->name, port);
+
+		/* the last ports get hubs, as long as there is room below them */
+		if ((port > gen->fanout - hubs) && (hub->tier + 1 < gen->depth)) {
+			make_device(gen, hub->path, name, hub->bus, gen->fanout, &hubKind, &path);
+			queue_hub(gen, path, name, hub->bus, hub->tier + 1);
+			continue;
+		}
+
+		kind = &leafKinds[rand_r(&gen->seed) % LEAF_KINDS];
+		make_device(gen, hub->path, name, hub->bus, 0, kind, NULL);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: gensysfs [-n devices] [-b buses] [-f fanout] [-d depth]\n"
+		"                [-i interfaces] [-e endpoints] [-s seed] DIR\n"
+		"\n"
+		"  -n  devices to make, root hubs and hubs included (100)\n"
+		"  -b  buses to spread them over (enough for 120 devices each)\n"
+		"  -f  ports on every hub (4)\n"
+		"  -d  tiers of hubs and devices, the root hub is tier 1 (%d)\n"
+		"  -i  interfaces of the composite devices (8)\n"
+		"  -e  endpoints of each of their interfaces (3)\n"
+		"  -s  seed for picking devices (1)\n", MAX_DEPTH);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct generator gen = {
+		.devices = 100,
+		.fanout = 4,
+		.depth = MAX_DEPTH,
+		.seed = 1,
+	};
+	int interfaces = 8;
+	int endpoints = 3;
+	int buses = 0;
+	struct hub hub;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "n:b:f:d:i:e:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			gen.devices = atoi(optarg);
+			break;
+		case 'b':
+			buses = atoi(optarg);
+			break;
+		case 'f':
+			gen.fanout = atoi(optarg);
+			break;
+		case 'd':
+			gen.depth = atoi(optarg);
+			break;
+		case 'i':
+			interfaces = atoi(optarg);
+			break;
+		case 'e':
+			endpoints = atoi(optarg);
+			break;
+		case 's':
+			gen.seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+	gen.root = argv[optind];
+
+	if (gen.devices < 1 || gen.fanout < 1 || gen.fanout > 31 ||
+	    gen.depth < 1 || gen.depth > MAX_DEPTH ||
+	    interfaces < 1 || interfaces > MAX_INTERFACES ||
+	    endpoints < 1 || endpoints > 4 ||
+	    interfaces * endpoints > MAX_ENDPOINTS)
+		usage();
+	if (buses <= 0)
+		buses = (gen.devices + 119) / 120;
+
+	composite_kind(&leafKinds[COMPOSITE_KIND], interfaces, endpoints);
+
+	if (mkdir(gen.root, 0755) && errno != EEXIST)
+		die("can not create", gen.root);
+	make_dir(&gen, "bus");
+	make_dir(&gen, "bus/usb");
+	make_dir(&gen, "bus/usb/devices");
+	make_dir(&gen, "bus/usb/drivers");
+	make_dir(&gen, "bus/usb/drivers/usb");
+	make_dir(&gen, "devices");
+	make_dir(&gen, "devices/pci0000:00");
+
+	for (i = 0; i < buses && gen.made < gen.devices; ++i)
+		add_bus(&gen);
+
+	/* breadth first, so all buses get filled up evenly */
+	while (gen.made < gen.devices) {
+		if (gen.queueHead == gen.queueTail) {
+			add_bus(&gen);
+			continue;
+		}
+		/* a copy, filling it up may move the queue */
+		hub = gen.queue[gen.queueHead++];
+		fill_hub(&gen, &hub);
+	}
+
+	for (i = 0; i < gen.queueTail; ++i) {
+		free(gen.queue[i].path);
+		free(gen.queue[i].name);
+	}
+	free(gen.queue);
+
+	printf("%d devices on %d buses in %s\n", gen.made, gen.buses, gen.root);
+	return 0;
+}
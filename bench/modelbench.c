@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * modelbench.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Time a refresh of the tree rows, from one scan of the devices to the
+ * next, usually of two trees made up by gensysfs:
+ *
+ *	modelbench [--runs=N] [--header] OLD NEW
+ *
+ * OLD and NEW are scanned once each.  Then for every run a new tree model
+ * is set up with the OLD snapshot, and only switching it over to the NEW
+ * one is timed, which is all a refresh does to the tree rows.  Prints one
+ * line with the number of devices in both, the rows the view was told
+ * were inserted, removed and changed, and the fastest and the median
+ * time of the switch.  A new hub counts as one inserted row, the view
+ * finds the rows below it by itself.
+ *
+ * No window is opened, and no display is needed, as the model does not
+ * care if anyone is looking at it.
+ */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "sysfs.h"
+#include "usbtreemodel.h"
+
+static gint runs = 5;
+static gboolean header = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "runs", 0, 0, G_OPTION_ARG_INT, &runs,
+	  "Number of refreshes to time", "N" },
+	{ "header", 0, 0, G_OPTION_ARG_NONE, &header,
+	  "Print what the columns are first", NULL },
+	{ NULL }
+};
+
+/* the rows the view was told about during one refresh */
+struct rows {
+	guint	inserted;
+	guint	removed;
+	guint	changed;
+};
+
+static void row_inserted(GtkTreeModel *model, GtkTreePath *path,
+			 GtkTreeIter *iter, gpointer data)
+{
+	struct rows *rows = data;
+
+	++rows->inserted;
+}
+
+static void row_deleted(GtkTreeModel *model, GtkTreePath *path, gpointer data)
+{
+	struct rows *rows = data;
+
+	++rows->removed;
+}
+
+static void row_changed(GtkTreeModel *model, GtkTreePath *path,
+			GtkTreeIter *iter, gpointer data)
+{
+	struct rows *rows = data;
+
+	++rows->changed;
+}
+
+static struct UsbSnapshot *scan(const char *root)
+{
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+
+	usb_set_sysfs_root(root);
+	snapshot = usb_snapshot_scan(NULL, NULL, &error);
+	if (snapshot == NULL) {
+		g_printerr("%s\n", error->message);
+		exit(1);
+	}
+	if (g_hash_table_size(snapshot->byName) == 0) {
+		g_printerr("no devices found in %s\n", root);
+		exit(1);
+	}
+	return snapshot;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+	gint64 first = *(const gint64 *)a;
+	gint64 second = *(const gint64 *)b;
+
+	return (first > second) - (first < second);
+}
+
+int main(int argc, char *argv[])
+{
+	struct UsbSnapshot *oldSnapshot;
+	struct UsbSnapshot *newSnapshot;
+	GOptionContext *context;
+	GError *error = NULL;
+	UsbTreeModel *model;
+	struct rows rows;
+	gint64 *times;
+	gint i;
+
+	context = g_option_context_new("OLD NEW");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	if (argc != 3 || runs < 1) {
+		g_printerr("usage: modelbench [--runs=N] [--header] OLD NEW\n");
+		return 2;
+	}
+
+	oldSnapshot = scan(argv[1]);
+	newSnapshot = scan(argv[2]);
+
+	if (header)
+		printf("%8s %8s %8s %8s %8s %10s %10s\n", "old", "new",
+		       "inserted", "removed", "changed", "min ms", "median ms");
+
+	times = g_new(gint64, runs);
+	for (i = 0; i < runs; ++i) {
+		GPtrArray *inserted;
+
+		model = usb_tree_model_new();
+		g_ptr_array_unref(usb_tree_model_set_snapshot(model, oldSnapshot));
+
+		memset(&rows, 0x00, sizeof(rows));
+		g_signal_connect(model, "row-inserted", G_CALLBACK(row_inserted), &rows);
+		g_signal_connect(model, "row-deleted", G_CALLBACK(row_deleted), &rows);
+		g_signal_connect(model, "row-changed", G_CALLBACK(row_changed), &rows);
+
+		times[i] = g_get_monotonic_time();
+		inserted = usb_tree_model_set_snapshot(model, newSnapshot);
+		times[i] = g_get_monotonic_time() - times[i];
+
+		g_ptr_array_unref(inserted);
+		g_object_unref(model);
+	}
+	qsort(times, runs, sizeof(*times), compare_times);
+
+	printf("%8u %8u %8u %8u %8u %10.2f %10.2f\n",
+	       g_hash_table_size(oldSnapshot->byName),
+	       g_hash_table_size(newSnapshot->byName),
+	       rows.inserted, rows.removed, rows.changed,
+	       times[0] / 1000.0, times[runs / 2] / 1000.0);
+
+	usb_snapshot_unref(oldSnapshot);
+	usb_snapshot_unref(newSnapshot);
+	g_free(times);
+	return 0;
+}
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * scanbench.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Time full scans of a sysfs tree, usually one made up by gensysfs:
+ *
+ *	scanbench [--threads=N] [--runs=N] [--sync] [--header] DIR
+ *
+ * A scan is everything usbview does to get a new snapshot: listing the
+ * devices, reading them, naming them, and building and indexing the
+ * tree.  One scan is done first to warm up the caches and the thread
+ * pool, then the given number of them are timed.  Prints one line with
+ * the number of devices, the threads used, how the attributes were read,
+ * the fastest and the median scan time, the context switches and the
+ * read() calls of one scan, what the snapshot takes up, and the peak
+ * memory use of the whole process.
+ *
+ * With io_uring built in, the attributes are read through it unless
+ * --sync is given, or the kernel does not allow it.
+ *
+ * The thread pool can only be set up once, so every thread count needs
+ * a run of its own.
+ */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "arena.h"
+
+static gint threads = 0;
+static gint runs = 5;
+static gboolean syncReads = FALSE;
+static gboolean header = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "threads", 0, 0, G_OPTION_ARG_INT, &threads,
+	  "Number of threads used to scan the devices (0 for one per CPU)", "N" },
+	{ "runs", 0, 0, G_OPTION_ARG_INT, &runs,
+	  "Number of scans to time", "N" },
+	{ "sync", 0, 0, G_OPTION_ARG_NONE, &syncReads,
+	  "Read the attributes one at a time, even with io_uring", NULL },
+	{ "header", 0, 0, G_OPTION_ARG_NONE, &header,
+	  "Print what the columns are first", NULL },
+	{ NULL }
+};
+
+/*
+ * The read() calls made by the whole process so far, from all of its
+ * threads.  Zero if the kernel does not keep track of them.
+ */
+static guint64 read_calls(void)
+{
+	gchar *contents;
+	gchar *line;
+	guint64 count = 0;
+
+	if (!g_file_get_contents("/proc/self/io", &contents, NULL, NULL))
+		return 0;
+
+	line = strstr(contents, "syscr:");
+	if (line != NULL)
+		count = g_ascii_strtoull(line + 6, NULL, 10);
+
+	g_free(contents);
+	return count;
+}
+
+/* context switches of the whole process so far, from all of its threads */
+static glong context_switches(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+	gint64 first = *(const gint64 *)a;
+	gint64 second = *(const gint64 *)b;
+
+	return (first > second) - (first < second);
+}
+
+int main(int argc, char *argv[])
+{
+	struct UsbSnapshot *snapshot;
+	GOptionContext *context;
+	GError *error = NULL;
+	struct rusage usage;
+	const char *io;
+	gint64 *times;
+	guint64 reads;
+	glong switches;
+	guint devices;
+	gsize size;
+	gint i;
+
+	context = g_option_context_new("DIR");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	if (argc != 2 || runs < 1) {
+		g_printerr("usage: scanbench [--threads=N] [--runs=N] [--sync] [--header] DIR\n");
+		return 2;
+	}
+
+	usb_set_sysfs_root(argv[1]);
+	usb_set_scan_threads(threads);
+	usb_set_scan_uring(!syncReads);
+
+	if (header)
+		printf("%8s %7s %6s %10s %10s %8s %8s %10s %10s\n", "devices", "threads",
+		       "io", "min ms", "median ms", "switches", "reads", "snapshot",
+		       "peak rss");
+
+	/* warm up, and count what one scan does */
+	reads = read_calls();
+	snapshot = usb_snapshot_scan(NULL, NULL, &error);
+	reads = read_calls() - reads;
+	if (snapshot == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	devices = g_hash_table_size(snapshot->byName);
+	size = arena_size(snapshot->arena);
+	usb_snapshot_unref(snapshot);
+
+	if (devices == 0) {
+		g_printerr("no devices found in %s\n", argv[1]);
+		return 1;
+	}
+
+	times = g_new(gint64, runs);
+	switches = context_switches();
+	for (i = 0; i < runs; ++i) {
+		times[i] = g_get_monotonic_time();
+		snapshot = usb_snapshot_scan(NULL, NULL, NULL);
+		times[i] = g_get_monotonic_time() - times[i];
+		usb_snapshot_unref(snapshot);
+	}
+	switches = context_switches() - switches;
+	qsort(times, runs, sizeof(*times), compare_times);
+
+	getrusage(RUSAGE_SELF, &usage);
+
+#ifdef HAVE_LIBURING
+	io = syncReads ? "sync" : "uring";
+#else
+	io = "sync";
+#endif
+
+	printf("%8u %7d %6s %10.2f %10.2f %8ld %8" G_GUINT64_FORMAT " %9" G_GSIZE_FORMAT "k %9ldk\n",
+	       devices, threads > 0 ? threads : (gint)g_get_num_processors(), io,
+	       times[0] / 1000.0, times[runs / 2] / 1000.0, switches / runs,
+	       reads, size / 1024, usage.ru_maxrss);
+
+	g_free(times);
+	return 0;
+}
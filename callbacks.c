@@ -52,6 +52,23 @@ void on_buttonAbout_clicked (GtkButton *button, gpointer user_data)
 }
 
 
+void on_buttonStats_clicked (GtkButton *button, gpointer user_data)
+{
+	GtkWidget *dialog;
+	gchar *text;
+
+	text = DescribeUSBScan ();
+	dialog = gtk_message_dialog_new (GTK_WINDOW (windowMain),
+					 GTK_DIALOG_DESTROY_WITH_PARENT,
+					 GTK_MESSAGE_INFO, GTK_BUTTONS_CLOSE,
+					 "Scan statistics");
+	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", text);
+	gtk_dialog_run (GTK_DIALOG (dialog));
+	gtk_widget_destroy (dialog);
+	g_free (text);
+}
+
+
 gint on_timer_timeout (gpointer user_data)
 {
 	LoadUSBTree(0);
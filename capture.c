@@ -0,0 +1,366 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * capture.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Copy the sysfs files of all USB devices into a single tar archive, so a
+ * machine's devices can be looked at, and scanned, somewhere else:
+ *
+ *	usbview --capture=host.tar
+ *	mkdir host && tar xf host.tar -C host
+ *	usbview --sysfs-root=host
+ *
+ * Only the files a scan reads are copied, into the same directories as
+ * in sysfs, and bus/usb/devices links to them just like it does there.
+ * The driver links point to bus/usb/drivers in the archive instead, as
+ * only the name of the driver matters to a scan.
+ */
+
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "capture.h"
+
+#define TAR_BLOCK	512
+
+struct tar_header {
+	char	name[100];
+	char	mode[8];
+	char	uid[8];
+	char	gid[8];
+	char	size[12];
+	char	mtime[12];
+	char	checksum[8];
+	char	type;
+	char	linkname[100];
+	char	magic[6];
+	char	version[2];
+	char	uname[32];
+	char	gname[32];
+	char	devmajor[8];
+	char	devminor[8];
+	char	prefix[155];
+	char	pad[12];
+};
+
+struct capture {
+	GByteArray	*tar;
+	GHashTable	*drivers;	/* the driver directories written so far */
+	gint64		mtime;
+	guint		entries;
+};
+
+static void tar_header (struct capture *capture, const gchar *name, char type,
+			const gchar *link, gsize size)
+{
+	struct tar_header header;
+	const guint8 *byte;
+	guint sum = 0;
+	gsize i;
+
+	memset (&header, 0x00, sizeof (header));
+	strncpy (header.name, name, sizeof (header.name) - 1);
+	snprintf (header.mode, sizeof (header.mode), "%07o",
+		  (type == '5') ? 0755 : (type == '2') ? 0777 : 0444);
+	snprintf (header.uid, sizeof (header.uid), "%07o", 0);
+	snprintf (header.gid, sizeof (header.gid), "%07o", 0);
+	snprintf (header.size, sizeof (header.size), "%011o", (guint)size);
+	snprintf (header.mtime, sizeof (header.mtime), "%011o", (guint)capture->mtime);
+	header.type = type;
+	if (link)
+		strncpy (header.linkname, link, sizeof (header.linkname) - 1);
+	memcpy (header.magic, "ustar ", 6);
+	memcpy (header.version, " ", 2);
+	strcpy (header.uname, "root");
+	strcpy (header.gname, "root");
+
+	/* the checksum is taken with the checksum field all spaces */
+	memset (header.checksum, ' ', sizeof (header.checksum));
+	for (byte = (const guint8 *)&header, i = 0; i < sizeof (header); ++i)
+		sum += byte[i];
+	snprintf (header.checksum, sizeof (header.checksum), "%06o", sum);
+
+	g_byte_array_append (capture->tar, (const guint8 *)&header, sizeof (header));
+}
+
+/* file data is padded up to a whole block */
+static void tar_data (struct capture *capture, const void *data, gsize size)
+{
+	static const guint8 zeros[TAR_BLOCK];
+
+	g_byte_array_append (capture->tar, data, size);
+	if (size % TAR_BLOCK)
+		g_byte_array_append (capture->tar, zeros, TAR_BLOCK - size % TAR_BLOCK);
+}
+
+/*
+ * One entry of the archive.  Names and links that do not fit in the
+ * header, as they easily do not deep down in sysfs, go in a GNU long
+ * name entry right before it, which every tar knows about.
+ */
+static void tar_add (struct capture *capture, const gchar *name, char type,
+		     const gchar *link, const void *data, gsize size)
+{
+	struct tar_header *header = NULL;
+
+	if (strlen (name) >= sizeof (header->name)) {
+		tar_header (capture, "././@LongLink", 'L', NULL, strlen (name) + 1);
+		tar_data (capture, name, strlen (name) + 1);
+	}
+	if (link && strlen (link) >= sizeof (header->linkname)) {
+		tar_header (capture, "././@LongLink", 'K', NULL, strlen (link) + 1);
+		tar_data (capture, link, strlen (link) + 1);
+	}
+
+	tar_header (capture, name, type, link, size);
+	if (size)
+		tar_data (capture, data, size);
+
+	++capture->entries;
+}
+
+static void tar_add_dir (struct capture *capture, const gchar *name)
+{
+	gchar *dir = g_strconcat (name, "/", NULL);
+
+	tar_add (capture, dir, '5', NULL, NULL, 0);
+	g_free (dir);
+}
+
+/*
+ * Where a link in bus/usb/devices points to, from the root of sysfs, or
+ * NULL if that is outside of it.  "../../../devices/pci0000:00/..." is
+ * "devices/pci0000:00/...".
+ */
+static gchar *resolve_link (const gchar *link)
+{
+	gchar **parts;
+	GPtrArray *path;
+	gchar *result = NULL;
+	gboolean outside = FALSE;
+	guint i;
+
+	path = g_ptr_array_new ();
+	g_ptr_array_add (path, "bus");
+	g_ptr_array_add (path, "usb");
+	g_ptr_array_add (path, "devices");
+
+	parts = g_strsplit (link, "/", -1);
+	for (i = 0; !outside && parts[i] != NULL; ++i) {
+		if ((parts[i][0] == 0x00) || (strcmp (parts[i], ".") == 0))
+			continue;
+		if (strcmp (parts[i], "..") == 0) {
+			if (path->len == 0)
+				outside = TRUE;
+			else
+				g_ptr_array_remove_index (path, path->len - 1);
+			continue;
+		}
+		g_ptr_array_add (path, parts[i]);
+	}
+
+	if (!outside && path->len) {
+		g_ptr_array_add (path, NULL);
+		result = g_strjoinv ("/", (gchar **)path->pdata);
+	}
+
+	g_ptr_array_free (path, TRUE);
+	g_strfreev (parts);
+	return result;
+}
+
+/* Copy those of the files a scan reads that are there, from "entry" to "dir" */
+static void capture_files (struct capture *capture, const gchar *devicesDir,
+			   const gchar *entry, const gchar *dir,
+			   const char * const *files)
+{
+	gchar *path;
+	gchar *name;
+	gchar *contents;
+	gsize length;
+
+	for (; *files != NULL; ++files) {
+		path = g_build_filename (devicesDir, entry, *files, NULL);
+		if (g_file_get_contents (path, &contents, &length, NULL)) {
+			name = g_strdup_printf ("%s/%s", dir, *files);
+			tar_add (capture, name, '0', NULL, contents, length);
+			g_free (name);
+			g_free (contents);
+		}
+		g_free (path);
+	}
+}
+
+/*
+ * Copy the files of one entry of bus/usb/devices that are there, and
+ * the link to it.
+ */
+static gboolean capture_entry (struct capture *capture, const gchar *devicesDir,
+			       const gchar *entry, GError **error)
+{
+	gchar *path;
+	gchar *name;
+	gchar *link;
+	gchar *dir;
+	gchar *driver;
+	gchar *up;
+	guint depth;
+	guint i;
+
+	/* in a real sysfs it is a link, but an unpacked capture can be captured again */
+	path = g_build_filename (devicesDir, entry, NULL);
+	link = g_file_read_link (path, NULL);
+	g_free (path);
+	if (link != NULL) {
+		dir = resolve_link (link);
+		if (dir == NULL) {
+			g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				     "%s/%s: points outside of sysfs", devicesDir, entry);
+			g_free (link);
+			return FALSE;
+		}
+		tar_add_dir (capture, dir);
+
+		name = g_strdup_printf ("bus/usb/devices/%s", entry);
+		tar_add (capture, name, '2', link, NULL, 0);
+		g_free (name);
+		g_free (link);
+	} else {
+		dir = g_strdup_printf ("bus/usb/devices/%s", entry);
+		tar_add_dir (capture, dir);
+	}
+
+	/* not every file is there for every device, or for interfaces */
+	capture_files (capture, devicesDir, entry, dir, usb_device_attributes);
+	capture_files (capture, devicesDir, entry, dir, usb_interface_attributes);
+
+	path = g_build_filename (devicesDir, entry, "driver", NULL);
+	link = g_file_read_link (path, NULL);
+	g_free (path);
+	if (link) {
+		driver = g_path_get_basename (link);
+
+		if (!g_hash_table_contains (capture->drivers, driver)) {
+			name = g_strdup_printf ("bus/usb/drivers/%s", driver);
+			tar_add_dir (capture, name);
+			g_free (name);
+			g_hash_table_add (capture->drivers, g_strdup (driver));
+		}
+
+		/* back up to the root from the directory the link is in */
+		up = g_strdup ("");
+		for (depth = 1, i = 0; dir[i]; ++i)
+			depth += (dir[i] == '/');
+		while (depth--) {
+			gchar *more = g_strconcat (up, "../", NULL);
+
+			g_free (up);
+			up = more;
+		}
+
+		name = g_strdup_printf ("%s/driver", dir);
+		path = g_strdup_printf ("%sbus/usb/drivers/%s", up, driver);
+		tar_add (capture, name, '2', path, NULL, 0);
+		g_free (path);
+		g_free (name);
+		g_free (up);
+		g_free (driver);
+		g_free (link);
+	}
+
+	g_free (dir);
+	return TRUE;
+}
+
+/* a note on where and when it was captured, for whoever looks at it later */
+static void capture_info (struct capture *capture)
+{
+	struct utsname uts;
+	GDateTime *now;
+	gchar *date;
+	gchar *text;
+
+	if (uname (&uts))
+		memset (&uts, 0x00, sizeof (uts));
+
+	now = g_date_time_new_now_utc ();
+	date = g_date_time_format (now, "%Y-%m-%d %H:%M:%S UTC");
+	text = g_strdup_printf ("usbview %s\nkernel %s %s\ncaptured %s\n",
+				VERSION, uts.release, uts.machine, date);
+
+	tar_add (capture, "usbview-capture", '0', NULL, text, strlen (text));
+
+	g_free (text);
+	g_free (date);
+	g_date_time_unref (now);
+}
+
+static gint compare_entries (gconstpointer a, gconstpointer b)
+{
+	return strcmp (*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+/*
+ * Write everything a scan reads from sysfs to "filename", as a tar file
+ * that unpacks into a tree that can be given to --sysfs-root.
+ */
+gboolean usb_sysfs_capture (const gchar *filename, guint *entries, GError **error)
+{
+	static const guint8 zeros[2 * TAR_BLOCK];
+	struct capture capture;
+	const gchar *devicesDir = usb_sysfs_devices_dir ();
+	const gchar *entry;
+	GPtrArray *names;
+	gboolean result;
+	GDir *dir;
+	guint i;
+
+	dir = g_dir_open (devicesDir, 0, error);
+	if (dir == NULL)
+		return FALSE;
+
+	names = g_ptr_array_new_with_free_func (g_free);
+	while ((entry = g_dir_read_name (dir)) != NULL)
+		g_ptr_array_add (names, g_strdup (entry));
+	g_dir_close (dir);
+	g_ptr_array_sort (names, compare_entries);
+
+	capture.tar = g_byte_array_new ();
+	capture.drivers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	capture.mtime = g_get_real_time () / G_USEC_PER_SEC;
+	capture.entries = 0;
+
+	capture_info (&capture);
+	tar_add_dir (&capture, "bus");
+	tar_add_dir (&capture, "bus/usb");
+	tar_add_dir (&capture, "bus/usb/devices");
+	tar_add_dir (&capture, "bus/usb/drivers");
+
+	result = TRUE;
+	for (i = 0; result && i < names->len; ++i)
+		result = capture_entry (&capture, devicesDir, g_ptr_array_index (names, i), error);
+
+	if (result) {
+		/* the end of the archive is two empty blocks */
+		g_byte_array_append (capture.tar, zeros, sizeof (zeros));
+		result = g_file_set_contents (filename, (const gchar *)capture.tar->data,
+					      capture.tar->len, error);
+	}
+
+	if (entries)
+		*entries = capture.entries;
+
+	g_hash_table_destroy (capture.drivers);
+	g_byte_array_unref (capture.tar);
+	g_ptr_array_unref (names);
+	return result;
+}
@@ -0,0 +1,11 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * capture.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, greg@kroah.com
+ */
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+gboolean usb_sysfs_capture(const gchar *filename, guint *entries, GError **error);
+
+#endif	/* __CAPTURE_H */
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * describe.c for USBView - a USB device viewer
+ * Copyright (c) 1999, 2000, 2021-2022, 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * The text that describes one device.  It only needs glib, so the window
+ * and the --dump mode can both use it.
+ */
+
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "sysfs.h"
+#include "describe.h"
+
+/* Put all of the info about a device into one string */
+gchar *DescribeDevice (const struct Device *device)
+{
+	GString *string;
+	const gchar *speed;
+	int     configNum;
+	int     interfaceNum;
+	int     endpointNum;
+
+	string = g_string_sized_new (1024);
+
+	/* add the name if we have one */
+	if (device->name != NULL)
+		g_string_append (string, device->name);
+
+	/* add the manufacturer if we have one */
+	if (device->manufacturer != NULL)
+		g_string_append_printf (string, "\nManufacturer: %s", device->manufacturer);
+
+	/* add the serial number if we have one */
+	if (device->serialNumber != NULL)
+		g_string_append_printf (string, "\nSerial Number: %s", device->serialNumber);
+
+	/* add speed */
+	switch (device->speed) {
+		case 1 :        speed = "1.5Mb/s (low)";   break;
+		case 12 :       speed = "12Mb/s (full)";   break;
+		case 480 :      speed = "480Mb/s (high)";  break;
+		case 5000 :     speed = "5Gb/s (super)";   break;
+		case 10000 :    speed = "10Gb/s (super+)"; break;
+		case 20000 :    speed = "20Gb/s (super+)"; break;
+		default :       speed = "unknown";         break;
+	}
+	g_string_append_printf (string, "\nSpeed: %s", speed);
+
+	/* Add Bus number and device address */
+	g_string_append_printf (string, "\nBus:%4d", device->busNumber);
+	g_string_append_printf (string, "\nAddress:%4d", device->deviceNumber);
+
+	/* add ports if available */
+	if (device->maxChildren)
+		g_string_append_printf (string, "\nNumber of Ports: %i", device->maxChildren);
+
+	/* add the bandwidth info if available */
+	if (device->bandwidth != NULL) {
+		g_string_append_printf (string, "\nBandwidth allocated: %i / %i us (%i%%)"
+					"\nTotal number of interrupt requests: %i"
+					"\nTotal number of isochronous requests: %i",
+					device->bandwidth->allocated, device->bandwidth->total,
+					device->bandwidth->percent,
+					device->bandwidth->numInterruptRequests,
+					device->bandwidth->numIsocRequests);
+
+		if (usb_bandwidth_over (device->bandwidth))
+			g_string_append (string, "\nWarning: running out of periodic bandwidth");
+	}
+
+	/* add the USB version, device class, subclass, protocol, max packet size, and the number of configurations (if it is there) */
+	if (device->version) {
+		g_string_append_printf (string, "\nUSB Version: %s\nDevice Class: %s\nDevice Subclass: %s\nDevice Protocol: %s\n"
+					"Maximum Default Endpoint Size: %i\nNumber of Configurations: %i",
+					device->version, device->class, device->subClass, device->protocol,
+					device->maxPacketSize, device->numConfigs);
+	}
+
+	/* add the vendor id, product id, and revision number (if it is there) */
+	if (device->vendorId) {
+		g_string_append_printf (string, "\nVendor Id: %.4x\nProduct Id: %.4x\nRevision Number: %s",
+					device->vendorId, device->productId, device->revisionNumber);
+	}
+
+	/* display all the info for the configs */
+	for (configNum = 0; configNum < device->configCount; ++configNum) {
+		struct DeviceConfig *config = device->config[configNum];
+
+		/* show this config */
+		g_string_append_printf (string, "\n\nConfig Number: %i%s\n\tNumber of Interfaces: %i\n\t"
+					"Attributes: %.2x\n\tMaxPower Needed: %s",
+					config->configNumber, config->active ? " (active)" : "",
+					config->numInterfaces,
+					config->attributes, config->maxPower);
+
+		/* show all of the interfaces for this config */
+		for (interfaceNum = 0; interfaceNum < config->interfaceCount; ++interfaceNum) {
+			struct DeviceInterface *interface = config->interface[interfaceNum];
+
+			g_string_append_printf (string, "\n\n\tInterface Number: %i", interface->interfaceNumber);
+
+			if (interface->name != NULL)
+				g_string_append_printf (string, "\n\t\tName: %s", interface->name);
+
+			g_string_append_printf (string, "\n\t\tAlternate Number: %i%s\n\t\tClass: %s\n\t\t"
+						"Sub Class: %.2x\n\t\tProtocol: %.2x\n\t\tNumber of Endpoints: %i",
+						interface->alternateNumber,
+						interface->active ? " (active)" : "",
+						interface->class,
+						interface->subClass, interface->protocol, interface->numEndpoints);
+
+			/* show all of the endpoints for this interface */
+			for (endpointNum = 0; endpointNum < interface->endpointCount; ++endpointNum) {
+				struct DeviceEndpoint *endpoint = interface->endpoint[endpointNum];
+
+				g_string_append_printf (string, "\n\n\t\t\tEndpoint Address: %.2x\n\t\t\t"
+							"Direction: %s\n\t\t\tAttribute: %i\n\t\t\t"
+							"Type: %s\n\t\t\tMax Packet Size: %i\n\t\t\tInterval: %s",
+							endpoint->address,
+							endpoint->in ? "in" : "out", endpoint->attribute,
+							endpoint->type, endpoint->maxPacketSize, endpoint->interval);
+			}
+		}
+	}
+
+	return g_string_free (string, FALSE);
+}
+
+/* What building a snapshot took, see struct UsbScanStats */
+gchar *DescribeScanStats (const struct UsbScanStats *stats)
+{
+	GString *string;
+
+	string = g_string_sized_new (512);
+
+	g_string_append_printf (string, "Devices: %u\nInterfaces: %u\nEndpoints: %u\n"
+				"Memory: %" G_GSIZE_FORMAT " bytes",
+				stats->devices, stats->interfaces, stats->endpoints,
+				stats->bytes);
+
+	/* a snapshot loaded from a file was never scanned */
+	if (stats->totalTime == 0)
+		return g_string_free (string, FALSE);
+
+	g_string_append_printf (string, "\nDevices Read: %u\n"
+				"Listing: %.3f ms\nReading: %.3f ms\nLinking: %.3f ms\n"
+				"Naming: %.3f ms\nIndexing: %.3f ms\nTotal: %.3f ms",
+				stats->devicesRead,
+				stats->listTime / 1000.0, stats->readTime / 1000.0,
+				stats->linkTime / 1000.0, stats->nameTime / 1000.0,
+				stats->indexTime / 1000.0, stats->totalTime / 1000.0);
+
+	if (stats->counted)
+		g_string_append_printf (string, "\nOpens: %u\nReads: %u\n"
+					"Readlinks: %u\nDirectory Reads: %u",
+					stats->calls[USB_SCAN_OPENS],
+					stats->calls[USB_SCAN_READS],
+					stats->calls[USB_SCAN_READLINKS],
+					stats->calls[USB_SCAN_DIR_READS]);
+
+	return g_string_free (string, FALSE);
+}
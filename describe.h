@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * describe.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, greg@kroah.com
+ */
+#ifndef __DESCRIBE_H
+#define __DESCRIBE_H
+
+struct Device;
+struct UsbScanStats;
+
+gchar *DescribeDevice (const struct Device *device);
+gchar *DescribeScanStats (const struct UsbScanStats *stats);
+
+#endif	/* __DESCRIBE_H */
@@ -0,0 +1,559 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * diff.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * What changed between two snapshots of the device tree.
+ *
+ * Devices are first matched up by where they are plugged in, which is
+ * their kernel name.  Every device carries a hash of itself and of
+ * everything plugged into it, so a hub whose hash did not change is done
+ * with right away, no matter how much hangs off of it.  What is left over
+ * on either side afterwards is matched up by vendor, product and serial
+ * number, to find the devices that were moved to another port.
+ */
+
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "diff.h"
+
+/* everything one diff needs while it is being worked out */
+struct diff_run {
+	struct UsbDiff	*diff;
+	GPtrArray	*removed;	/* devices only found in the old tree, so far */
+	GPtrArray	*added;		/* and only in the new one */
+};
+
+static void entry_free (gpointer data)
+{
+	struct UsbDiffEntry *entry = data;
+
+	g_free (entry->details);
+	g_free (entry);
+}
+
+static struct UsbDiffEntry *diff_entry (struct UsbDiff *diff, struct Device *oldDevice,
+					struct Device *newDevice, guint flags,
+					GString *details)
+{
+	struct UsbDiffEntry *entry;
+
+	entry = g_new0 (struct UsbDiffEntry, 1);
+	entry->oldDevice = oldDevice;
+	entry->newDevice = newDevice;
+	entry->flags = flags;
+	if (details != NULL && details->len)
+		entry->details = g_strndup (details->str, details->len);
+
+	g_ptr_array_add (diff->entries, entry);
+	if (newDevice != NULL)
+		g_hash_table_insert (diff->byNewDevice, newDevice, entry);
+
+	return entry;
+}
+
+static void changed_int (GString *details, guint *flags, guint flag,
+			 const gchar *prefix, const gchar *field, gint oldValue, gint newValue)
+{
+	if (oldValue == newValue)
+		return;
+
+	g_string_append_printf (details, "%s%s: %d -> %d\n", prefix, field, oldValue, newValue);
+	*flags |= flag;
+}
+
+static void changed_hex (GString *details, guint *flags, guint flag,
+			 const gchar *prefix, const gchar *field, gint oldValue, gint newValue)
+{
+	if (oldValue == newValue)
+		return;
+
+	g_string_append_printf (details, "%s%s: %.2x -> %.2x\n", prefix, field, oldValue, newValue);
+	*flags |= flag;
+}
+
+static void changed_string (GString *details, guint *flags, guint flag,
+			    const gchar *prefix, const gchar *field,
+			    const gchar *oldValue, const gchar *newValue)
+{
+	if (g_strcmp0 (oldValue, newValue) == 0)
+		return;
+
+	g_string_append_printf (details, "%s%s: %s -> %s\n", prefix, field,
+				oldValue ? oldValue : "(none)", newValue ? newValue : "(none)");
+	*flags |= flag;
+}
+
+static struct DeviceEndpoint *find_endpoint (const struct DeviceInterface *interface,
+					     gint address)
+{
+	int i;
+
+	for (i = 0; i < interface->endpointCount; ++i) {
+		if (interface->endpoint[i]->address == address)
+			return interface->endpoint[i];
+	}
+	return NULL;
+}
+
+static struct DeviceInterface *find_interface (const struct DeviceConfig *config,
+					       gint interfaceNumber, gint alternateNumber)
+{
+	int i;
+
+	for (i = 0; i < config->interfaceCount; ++i) {
+		if (config->interface[i]->interfaceNumber == interfaceNumber &&
+		    config->interface[i]->alternateNumber == alternateNumber)
+			return config->interface[i];
+	}
+	return NULL;
+}
+
+static struct DeviceConfig *find_config (const struct Device *device, gint configNumber)
+{
+	int i;
+
+	for (i = 0; i < device->configCount; ++i) {
+		if (device->config[i]->configNumber == configNumber)
+			return device->config[i];
+	}
+	return NULL;
+}
+
+static void diff_endpoints (GString *details, guint *flags, const gchar *prefix,
+			    const struct DeviceInterface *oldInterface,
+			    const struct DeviceInterface *newInterface)
+{
+	gchar *where;
+	int i;
+
+	for (i = 0; i < oldInterface->endpointCount; ++i) {
+		const struct DeviceEndpoint *oldEndpoint = oldInterface->endpoint[i];
+		const struct DeviceEndpoint *newEndpoint;
+
+		newEndpoint = find_endpoint (newInterface, oldEndpoint->address);
+		if (newEndpoint == NULL) {
+			g_string_append_printf (details, "%sendpoint %.2x removed\n",
+						prefix, oldEndpoint->address);
+			*flags |= USB_DIFF_CHANGED;
+			continue;
+		}
+
+		where = g_strdup_printf ("%sendpoint %.2x ", prefix, oldEndpoint->address);
+		changed_int (details, flags, USB_DIFF_CHANGED, where, "attribute",
+			     oldEndpoint->attribute, newEndpoint->attribute);
+		changed_string (details, flags, USB_DIFF_CHANGED, where, "type",
+				oldEndpoint->type, newEndpoint->type);
+		changed_int (details, flags, USB_DIFF_CHANGED, where, "max packet size",
+			     oldEndpoint->maxPacketSize, newEndpoint->maxPacketSize);
+		changed_string (details, flags, USB_DIFF_CHANGED, where, "interval",
+				oldEndpoint->interval, newEndpoint->interval);
+		g_free (where);
+	}
+
+	for (i = 0; i < newInterface->endpointCount; ++i) {
+		if (find_endpoint (oldInterface, newInterface->endpoint[i]->address) == NULL) {
+			g_string_append_printf (details, "%sendpoint %.2x added\n",
+						prefix, newInterface->endpoint[i]->address);
+			*flags |= USB_DIFF_CHANGED;
+		}
+	}
+}
+
+static void diff_interfaces (GString *details, guint *flags, const gchar *prefix,
+			     const struct DeviceConfig *oldConfig,
+			     const struct DeviceConfig *newConfig)
+{
+	gchar *where;
+	int i;
+
+	for (i = 0; i < oldConfig->interfaceCount; ++i) {
+		const struct DeviceInterface *oldInterface = oldConfig->interface[i];
+		const struct DeviceInterface *newInterface;
+
+		where = g_strdup_printf ("%sinterface %d.%d ", prefix,
+					 oldInterface->interfaceNumber,
+					 oldInterface->alternateNumber);
+
+		newInterface = find_interface (newConfig, oldInterface->interfaceNumber,
+					       oldInterface->alternateNumber);
+		if (newInterface == NULL) {
+			g_string_append_printf (details, "%sremoved\n", where);
+			*flags |= USB_DIFF_CHANGED;
+			g_free (where);
+			continue;
+		}
+
+		changed_string (details, flags, USB_DIFF_DRIVER, where, "driver",
+				oldInterface->name, newInterface->name);
+		changed_int (details, flags, USB_DIFF_DRIVER, where, "driver attached",
+			     oldInterface->driverAttached, newInterface->driverAttached);
+		changed_int (details, flags, USB_DIFF_CHANGED, where, "active",
+			     oldInterface->active, newInterface->active);
+		changed_string (details, flags, USB_DIFF_CHANGED, where, "class",
+				oldInterface->class, newInterface->class);
+		changed_hex (details, flags, USB_DIFF_CHANGED, where, "sub class",
+			     oldInterface->subClass, newInterface->subClass);
+		changed_hex (details, flags, USB_DIFF_CHANGED, where, "protocol",
+			     oldInterface->protocol, newInterface->protocol);
+		changed_int (details, flags, USB_DIFF_CHANGED, where, "number of endpoints",
+			     oldInterface->numEndpoints, newInterface->numEndpoints);
+		diff_endpoints (details, flags, where, oldInterface, newInterface);
+		g_free (where);
+	}
+
+	for (i = 0; i < newConfig->interfaceCount; ++i) {
+		const struct DeviceInterface *newInterface = newConfig->interface[i];
+
+		if (find_interface (oldConfig, newInterface->interfaceNumber,
+				    newInterface->alternateNumber) == NULL) {
+			g_string_append_printf (details, "%sinterface %d.%d added\n", prefix,
+						newInterface->interfaceNumber,
+						newInterface->alternateNumber);
+			*flags |= USB_DIFF_CHANGED;
+		}
+	}
+}
+
+/*
+ * Compare one device with its other copy, everything but its children.
+ * For a device that moved, where it is plugged in is not news any more.
+ */
+static void diff_device (struct UsbDiff *diff, struct Device *oldDevice,
+			 struct Device *newDevice, guint flags)
+{
+	GString *details;
+	gchar *where;
+	int i;
+
+	details = g_string_new (NULL);
+
+	if (!(flags & USB_DIFF_MOVED)) {
+		changed_int (details, &flags, USB_DIFF_REENUMERATED, "", "device number",
+			     oldDevice->deviceNumber, newDevice->deviceNumber);
+		changed_int (details, &flags, USB_DIFF_CHANGED, "", "connector",
+			     oldDevice->connectorNumber, newDevice->connectorNumber);
+	}
+	changed_int (details, &flags, USB_DIFF_SPEED, "", "speed",
+		     oldDevice->speed, newDevice->speed);
+	changed_string (details, &flags, USB_DIFF_CHANGED, "", "name",
+			oldDevice->name, newDevice->name);
+	changed_string (details, &flags, USB_DIFF_CHANGED, "", "manufacturer",
+			oldDevice->manufacturer, newDevice->manufacturer);
+	changed_string (details, &flags, USB_DIFF_CHANGED, "", "product",
+			oldDevice->product, newDevice->product);
+	changed_string (details, &flags, USB_DIFF_CHANGED, "", "USB version",
+			oldDevice->version, newDevice->version);
+	changed_string (details, &flags, USB_DIFF_CHANGED, "", "class",
+			oldDevice->class, newDevice->class);
+	changed_string (details, &flags, USB_DIFF_CHANGED, "", "sub class",
+			oldDevice->subClass, newDevice->subClass);
+	changed_string (details, &flags, USB_DIFF_CHANGED, "", "protocol",
+			oldDevice->protocol, newDevice->protocol);
+	changed_int (details, &flags, USB_DIFF_CHANGED, "", "max packet size",
+		     oldDevice->maxPacketSize, newDevice->maxPacketSize);
+	changed_int (details, &flags, USB_DIFF_CHANGED, "", "number of ports",
+		     oldDevice->maxChildren, newDevice->maxChildren);
+	changed_int (details, &flags, USB_DIFF_CHANGED, "", "number of configs",
+		     oldDevice->numConfigs, newDevice->numConfigs);
+	changed_string (details, &flags, USB_DIFF_CHANGED, "", "revision",
+			oldDevice->revisionNumber, newDevice->revisionNumber);
+
+	for (i = 0; i < oldDevice->configCount; ++i) {
+		const struct DeviceConfig *oldConfig = oldDevice->config[i];
+		const struct DeviceConfig *newConfig;
+
+		where = g_strdup_printf ("config %d ", oldConfig->configNumber);
+
+		newConfig = find_config (newDevice, oldConfig->configNumber);
+		if (newConfig == NULL) {
+			g_string_append_printf (details, "%sremoved\n", where);
+			flags |= USB_DIFF_CHANGED;
+			g_free (where);
+			continue;
+		}
+
+		changed_int (details, &flags, USB_DIFF_CHANGED, where, "active",
+			     oldConfig->active, newConfig->active);
+		changed_hex (details, &flags, USB_DIFF_CHANGED, where, "attributes",
+			     oldConfig->attributes, newConfig->attributes);
+		changed_string (details, &flags, USB_DIFF_CHANGED, where, "max power",
+				oldConfig->maxPower, newConfig->maxPower);
+		changed_int (details, &flags, USB_DIFF_CHANGED, where, "number of interfaces",
+			     oldConfig->numInterfaces, newConfig->numInterfaces);
+		diff_interfaces (details, &flags, where, oldConfig, newConfig);
+		g_free (where);
+	}
+
+	for (i = 0; i < newDevice->configCount; ++i) {
+		if (find_config (oldDevice, newDevice->config[i]->configNumber) == NULL) {
+			g_string_append_printf (details, "config %d added\n",
+						newDevice->config[i]->configNumber);
+			flags |= USB_DIFF_CHANGED;
+		}
+	}
+
+	if (flags)
+		diff_entry (diff, oldDevice, newDevice, flags, details);
+
+	g_string_free (details, TRUE);
+}
+
+/* is it the same device, wherever it is plugged in */
+static gboolean same_device (const struct Device *oldDevice, const struct Device *newDevice)
+{
+	return (oldDevice->vendorId == newDevice->vendorId) &&
+	       (oldDevice->productId == newDevice->productId) &&
+	       (g_strcmp0 (oldDevice->serialNumber, newDevice->serialNumber) == 0);
+}
+
+static void collect (GPtrArray *devices, struct Device *device)
+{
+	int i;
+
+	g_ptr_array_add (devices, device);
+	for (i = 0; i < device->childCount; ++i)
+		collect (devices, device->child[i]);
+}
+
+/* Compare two devices plugged into the same place, and everything below them */
+static void diff_subtree (struct diff_run *run, struct Device *oldDevice,
+			  struct Device *newDevice)
+{
+	struct UsbDiff *diff = run->diff;
+	struct Device *other;
+	int i;
+
+	diff->compared++;
+	if (oldDevice->subtreeHash == newDevice->subtreeHash) {
+		diff->skipped++;
+		return;
+	}
+
+	/* somebody unplugged it and put something else in */
+	if ((oldDevice->parent != NULL) && !same_device (oldDevice, newDevice)) {
+		collect (run->removed, oldDevice);
+		collect (run->added, newDevice);
+		return;
+	}
+
+	if ((oldDevice->parent != NULL) && (oldDevice->hash != newDevice->hash))
+		diff_device (diff, oldDevice, newDevice, 0);
+
+	/*
+	 * The kernel name is the port path, so it is the same for the same
+	 * port.  The parent may be an older copy of the hub, so go by its
+	 * name as well.
+	 */
+	for (i = 0; i < oldDevice->childCount; ++i) {
+		other = usb_find_device_by_name (diff->newSnapshot,
+						 oldDevice->child[i]->sysfsName);
+		if (other != NULL &&
+		    g_strcmp0 (other->parent->sysfsName, newDevice->sysfsName) == 0)
+			diff_subtree (run, oldDevice->child[i], other);
+		else
+			collect (run->removed, oldDevice->child[i]);
+	}
+
+	for (i = 0; i < newDevice->childCount; ++i) {
+		other = usb_find_device_by_name (diff->oldSnapshot,
+						 newDevice->child[i]->sysfsName);
+		if (other == NULL ||
+		    g_strcmp0 (other->parent->sysfsName, oldDevice->sysfsName) != 0)
+			collect (run->added, newDevice->child[i]);
+	}
+}
+
+static gchar *identity (const struct Device *device)
+{
+	return g_strdup_printf ("%04x:%04x:%s", device->vendorId, device->productId,
+				device->serialNumber ? device->serialNumber : "");
+}
+
+/*
+ * Pair up the devices that went away with the ones that showed up, when
+ * there is only one of each that could be the same device.
+ */
+static void find_moved (struct diff_run *run)
+{
+	GHashTable *removed;
+	GHashTable *added;
+	GHashTable *paired;
+	GPtrArray *candidates;
+	GPtrArray *stillRemoved;
+	GPtrArray *stillAdded;
+	gchar *key;
+	guint i;
+
+	removed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					 (GDestroyNotify)g_ptr_array_unref);
+	added = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	for (i = 0; i < run->removed->len; ++i) {
+		key = identity (g_ptr_array_index (run->removed, i));
+		candidates = g_hash_table_lookup (removed, key);
+		if (candidates == NULL) {
+			candidates = g_ptr_array_new ();
+			g_hash_table_insert (removed, key, candidates);
+		} else {
+			g_free (key);
+		}
+		g_ptr_array_add (candidates, g_ptr_array_index (run->removed, i));
+	}
+
+	for (i = 0; i < run->added->len; ++i) {
+		key = identity (g_ptr_array_index (run->added, i));
+		g_hash_table_insert (added, key,
+				     GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (added, key)) + 1));
+	}
+
+	paired = g_hash_table_new (g_direct_hash, g_direct_equal);
+	stillAdded = g_ptr_array_sized_new (run->added->len);
+	for (i = 0; i < run->added->len; ++i) {
+		struct Device *newDevice = g_ptr_array_index (run->added, i);
+		struct Device *oldDevice;
+
+		key = identity (newDevice);
+		candidates = g_hash_table_lookup (removed, key);
+		if (candidates != NULL && candidates->len == 1 &&
+		    GPOINTER_TO_UINT (g_hash_table_lookup (added, key)) == 1) {
+			oldDevice = g_ptr_array_index (candidates, 0);
+			g_hash_table_add (paired, oldDevice);
+
+			/* the same device still in the same place, just below a new hub */
+			if (strcmp (oldDevice->sysfsName, newDevice->sysfsName) == 0)
+				diff_device (run->diff, oldDevice, newDevice, 0);
+			else
+				diff_device (run->diff, oldDevice, newDevice, USB_DIFF_MOVED);
+		} else {
+			g_ptr_array_add (stillAdded, newDevice);
+		}
+		g_free (key);
+	}
+
+	stillRemoved = g_ptr_array_sized_new (run->removed->len);
+	for (i = 0; i < run->removed->len; ++i) {
+		if (!g_hash_table_contains (paired, g_ptr_array_index (run->removed, i)))
+			g_ptr_array_add (stillRemoved, g_ptr_array_index (run->removed, i));
+	}
+
+	g_ptr_array_unref (run->removed);
+	g_ptr_array_unref (run->added);
+	run->removed = stillRemoved;
+	run->added = stillAdded;
+
+	g_hash_table_destroy (paired);
+	g_hash_table_destroy (added);
+	g_hash_table_destroy (removed);
+}
+
+/*
+ * Work out everything that changed from one snapshot to another.  The
+ * snapshots are held on to until the diff is freed.
+ */
+struct UsbDiff *usb_diff_new (struct UsbSnapshot *oldSnapshot,
+			      struct UsbSnapshot *newSnapshot)
+{
+	struct diff_run run;
+	struct UsbDiff *diff;
+	gint64 start;
+	guint i;
+
+	start = g_get_monotonic_time ();
+
+	diff = g_new0 (struct UsbDiff, 1);
+	diff->oldSnapshot = usb_snapshot_ref (oldSnapshot);
+	diff->newSnapshot = usb_snapshot_ref (newSnapshot);
+	diff->entries = g_ptr_array_new_with_free_func (entry_free);
+	diff->byNewDevice = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	run.diff = diff;
+	run.removed = g_ptr_array_new ();
+	run.added = g_ptr_array_new ();
+
+	diff_subtree (&run, oldSnapshot->root, newSnapshot->root);
+	if (run.removed->len && run.added->len)
+		find_moved (&run);
+
+	for (i = 0; i < run.removed->len; ++i)
+		diff_entry (diff, g_ptr_array_index (run.removed, i), NULL,
+			    USB_DIFF_REMOVED, NULL);
+	for (i = 0; i < run.added->len; ++i)
+		diff_entry (diff, NULL, g_ptr_array_index (run.added, i),
+			    USB_DIFF_ADDED, NULL);
+
+	g_ptr_array_unref (run.added);
+	g_ptr_array_unref (run.removed);
+
+	g_debug ("diff: %u changes, %u devices compared, %u subtrees skipped, %" G_GINT64_FORMAT " us",
+		 diff->entries->len, diff->compared, diff->skipped,
+		 g_get_monotonic_time () - start);
+
+	return diff;
+}
+
+void usb_diff_free (struct UsbDiff *diff)
+{
+	if (diff == NULL)
+		return;
+
+	g_hash_table_destroy (diff->byNewDevice);
+	g_ptr_array_unref (diff->entries);
+	usb_snapshot_unref (diff->newSnapshot);
+	usb_snapshot_unref (diff->oldSnapshot);
+	g_free (diff);
+}
+
+/* what happened to a device of the new snapshot, or NULL if nothing did */
+const struct UsbDiffEntry *usb_diff_lookup (struct UsbDiff *diff,
+					    const struct Device *newDevice)
+{
+	return g_hash_table_lookup (diff->byNewDevice, newDevice);
+}
+
+/* A line saying what happened, then the details of what changed */
+gchar *usb_diff_describe (const struct UsbDiffEntry *entry)
+{
+	static const struct {
+		guint		flag;
+		const gchar	*text;
+	} kinds[] = {
+		{ USB_DIFF_ADDED,		"added" },
+		{ USB_DIFF_REMOVED,		"removed" },
+		{ USB_DIFF_MOVED,		"moved" },
+		{ USB_DIFF_REENUMERATED,	"re-enumerated" },
+		{ USB_DIFF_SPEED,		"speed changed" },
+		{ USB_DIFF_DRIVER,		"driver changed" },
+		{ USB_DIFF_CHANGED,		"descriptors changed" },
+	};
+	GString *string;
+	guint i;
+
+	string = g_string_new (NULL);
+	for (i = 0; i < G_N_ELEMENTS (kinds); ++i) {
+		if (entry->flags & kinds[i].flag) {
+			if (string->len)
+				g_string_append (string, ", ");
+			g_string_append (string, kinds[i].text);
+		}
+	}
+
+	if (entry->flags & USB_DIFF_MOVED)
+		g_string_append_printf (string, "\nfrom %s to %s",
+					entry->oldDevice->sysfsName,
+					entry->newDevice->sysfsName);
+
+	if (entry->details != NULL) {
+		g_string_append_c (string, '\n');
+		g_string_append_len (string, entry->details, strlen (entry->details) - 1);
+	}
+
+	return g_string_free (string, FALSE);
+}
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * diff.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, greg@kroah.com
+ */
+#ifndef __DIFF_H
+#define __DIFF_H
+
+struct Device;
+struct UsbSnapshot;
+
+/* what happened to a device, more than one can be set */
+#define USB_DIFF_ADDED		(1 << 0)	/* only in the new tree */
+#define USB_DIFF_REMOVED	(1 << 1)	/* only in the old tree */
+#define USB_DIFF_MOVED		(1 << 2)	/* the same device, on another port */
+#define USB_DIFF_REENUMERATED	(1 << 3)	/* the same port, a new device number */
+#define USB_DIFF_SPEED		(1 << 4)	/* runs at another speed */
+#define USB_DIFF_DRIVER		(1 << 5)	/* an interface got another driver */
+#define USB_DIFF_CHANGED	(1 << 6)	/* any other descriptor field */
+
+struct UsbDiffEntry {
+	struct Device	*oldDevice;	/* NULL if it was added */
+	struct Device	*newDevice;	/* NULL if it was removed */
+	guint		flags;
+	gchar		*details;	/* what changed, one line each, or NULL */
+};
+
+/* Holds on to both snapshots, so the devices stay around as long as it does */
+struct UsbDiff {
+	struct UsbSnapshot *oldSnapshot;
+	struct UsbSnapshot *newSnapshot;
+	GPtrArray	*entries;	/* of struct UsbDiffEntry */
+	GHashTable	*byNewDevice;	/* new device -> its entry */
+	guint		compared;	/* pairs of devices looked at */
+	guint		skipped;	/* of those, the ones with nothing changed below */
+};
+
+struct UsbDiff *usb_diff_new(struct UsbSnapshot *oldSnapshot,
+			     struct UsbSnapshot *newSnapshot);
+void usb_diff_free(struct UsbDiff *diff);
+const struct UsbDiffEntry *usb_diff_lookup(struct UsbDiff *diff,
+					   const struct Device *newDevice);
+gchar *usb_diff_describe(const struct UsbDiffEntry *entry);
+
+#endif	/* __DIFF_H */
@@ -0,0 +1,534 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * dump.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Print the device tree, and then the details of every device, to stdout
+ * instead of showing them in a window, either as text or as one JSON
+ * object per device, or just the devices with a given id or serial
+ * number, or save them to a snapshot file, or capture the sysfs files
+ * they are read from.  None of this
+ * touches GTK, so it works on machines without a display, and usbview-dump
+ * is built from it without GTK linked in at all, which starts up a lot
+ * faster.
+ */
+
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "describe.h"
+#include "snapshot.h"
+#include "diff.h"
+#include "capture.h"
+#include "dump.h"
+
+/* big enough that even a large tree only takes a few writes */
+#define DUMP_BUFFER_SIZE	(64 * 1024)
+
+/*
+ * glib prints debug messages to stdout, right in the middle of the devices,
+ * so send everything to stderr instead while dumping.
+ */
+static void DumpLog (const gchar *domain, GLogLevelFlags level,
+		     const gchar *message, gpointer data)
+{
+	if ((level & (G_LOG_LEVEL_DEBUG | G_LOG_LEVEL_INFO)) &&
+	    (g_getenv ("G_MESSAGES_DEBUG") == NULL))
+		return;
+
+	fprintf (stderr, "%s%s%s\n", domain ? domain : "", domain ? ": " : "", message);
+}
+
+static void DumpTree (const struct Device *device, int depth)
+{
+	int i;
+
+	for (i = 0; i < device->childCount; ++i) {
+		const struct Device *child = device->child[i];
+
+		printf ("%*s%s\n", depth * 2, "", child->name);
+		DumpTree (child, depth + 1);
+	}
+}
+
+static void DumpDetails (const struct Device *device)
+{
+	gchar *text;
+	int i;
+
+	for (i = 0; i < device->childCount; ++i) {
+		text = DescribeDevice (device->child[i]);
+		printf ("\n%s\n", text);
+		g_free (text);
+
+		DumpDetails (device->child[i]);
+	}
+}
+
+/*
+ * The JSON output is one object per line ("NDJSON"), one line per device,
+ * parents before their children.  The keys are named after the fields of
+ * struct Device and friends, and every object starts with "schema", which
+ * goes up whenever a key is removed or changes its meaning.  New keys can
+ * show up without that, so readers should skip the ones they don't know.
+ */
+#define DUMP_JSON_SCHEMA	1
+
+/* add a string in quotes, or null, keeping to valid UTF-8 whatever sysfs said */
+static void JSONString (GString *json, const gchar *string)
+{
+	const gchar *end;
+	gunichar c;
+
+	if (string == NULL) {
+		g_string_append (json, "null");
+		return;
+	}
+
+	end = string + strlen (string);
+	g_string_append_c (json, '"');
+	while (string < end) {
+		guchar byte = *string;
+
+		if (byte == '"' || byte == '\\') {
+			g_string_append_c (json, '\\');
+			g_string_append_c (json, byte);
+		} else if (byte < 0x20) {
+			g_string_append_printf (json, "\\u%04x", byte);
+		} else if (byte < 0x80) {
+			g_string_append_c (json, byte);
+		} else {
+			c = g_utf8_get_char_validated (string, end - string);
+			if (c == (gunichar)-1 || c == (gunichar)-2) {
+				/* not UTF-8, so take it to be latin-1 */
+				g_string_append_printf (json, "\\u%04x", byte);
+			} else {
+				const gchar *next = g_utf8_next_char (string);
+
+				g_string_append_len (json, string, next - string);
+				string = next;
+				continue;
+			}
+		}
+		++string;
+	}
+	g_string_append_c (json, '"');
+}
+
+static void JSONKey (GString *json, const gchar *key)
+{
+	g_string_append_printf (json, ",\"%s\":", key);
+}
+
+static void JSONInt (GString *json, const gchar *key, gint value)
+{
+	g_string_append_printf (json, ",\"%s\":%d", key, value);
+}
+
+static void JSONBool (GString *json, const gchar *key, gboolean value)
+{
+	g_string_append_printf (json, ",\"%s\":%s", key, value ? "true" : "false");
+}
+
+static void JSONStr (GString *json, const gchar *key, const gchar *value)
+{
+	JSONKey (json, key);
+	JSONString (json, value);
+}
+
+static void JSONInterface (GString *json, const struct DeviceInterface *interface)
+{
+	int i;
+
+	g_string_append_printf (json, "{\"interfaceNumber\":%d", interface->interfaceNumber);
+	JSONInt (json, "alternateNumber", interface->alternateNumber);
+	JSONBool (json, "active", interface->active);
+	JSONStr (json, "class", interface->class);
+	JSONInt (json, "subClass", interface->subClass);
+	JSONInt (json, "protocol", interface->protocol);
+	JSONInt (json, "numEndpoints", interface->numEndpoints);
+	JSONStr (json, "driver", interface->name);
+	JSONBool (json, "driverAttached", interface->driverAttached);
+
+	g_string_append (json, ",\"endpoints\":[");
+	for (i = 0; i < interface->endpointCount; ++i) {
+		const struct DeviceEndpoint *endpoint = interface->endpoint[i];
+
+		if (i)
+			g_string_append_c (json, ',');
+		g_string_append_printf (json, "{\"address\":%d", endpoint->address);
+		JSONBool (json, "in", endpoint->in);
+		JSONInt (json, "attribute", endpoint->attribute);
+		JSONStr (json, "type", endpoint->type);
+		JSONInt (json, "maxPacketSize", endpoint->maxPacketSize);
+		JSONStr (json, "interval", endpoint->interval);
+		g_string_append_c (json, '}');
+	}
+	g_string_append (json, "]}");
+}
+
+static void JSONConfig (GString *json, const struct DeviceConfig *config)
+{
+	int i;
+
+	g_string_append_printf (json, "{\"configNumber\":%d", config->configNumber);
+	JSONBool (json, "active", config->active);
+	JSONInt (json, "numInterfaces", config->numInterfaces);
+	JSONInt (json, "attributes", config->attributes);
+	JSONStr (json, "maxPower", config->maxPower);
+
+	g_string_append (json, ",\"interfaces\":[");
+	for (i = 0; i < config->interfaceCount; ++i) {
+		if (i)
+			g_string_append_c (json, ',');
+		JSONInterface (json, config->interface[i]);
+	}
+	g_string_append (json, "]}");
+}
+
+/* fill "json" with the line for one device, reusing whatever it had room for */
+static void JSONDevice (GString *json, const struct Device *device)
+{
+	const struct Device *parent = device->parent;
+	int i;
+
+	g_string_truncate (json, 0);
+	g_string_append_printf (json, "{\"schema\":%d", DUMP_JSON_SCHEMA);
+	JSONStr (json, "sysfsName", device->sysfsName);
+	JSONStr (json, "parent", (parent && parent->sysfsName) ? parent->sysfsName : NULL);
+	JSONStr (json, "name", device->name);
+	JSONInt (json, "busNumber", device->busNumber);
+	JSONInt (json, "deviceNumber", device->deviceNumber);
+	JSONInt (json, "level", device->level);
+	JSONInt (json, "portNumber", device->portNumber);
+	JSONInt (json, "connectorNumber", device->connectorNumber);
+	JSONInt (json, "speed", device->speed);
+	JSONInt (json, "maxChildren", device->maxChildren);
+	JSONStr (json, "version", device->version);
+	JSONStr (json, "class", device->class);
+	JSONStr (json, "subClass", device->subClass);
+	JSONStr (json, "protocol", device->protocol);
+	JSONInt (json, "maxPacketSize", device->maxPacketSize);
+	JSONInt (json, "numConfigs", device->numConfigs);
+	JSONInt (json, "vendorId", device->vendorId);
+	JSONInt (json, "productId", device->productId);
+	JSONStr (json, "revisionNumber", device->revisionNumber);
+	JSONStr (json, "manufacturer", device->manufacturer);
+	JSONStr (json, "product", device->product);
+	JSONStr (json, "serialNumber", device->serialNumber);
+
+	JSONKey (json, "bandwidth");
+	if (device->bandwidth != NULL) {
+		g_string_append_printf (json, "{\"allocated\":%d", device->bandwidth->allocated);
+		JSONInt (json, "total", device->bandwidth->total);
+		JSONInt (json, "percent", device->bandwidth->percent);
+		JSONInt (json, "numInterruptRequests", device->bandwidth->numInterruptRequests);
+		JSONInt (json, "numIsocRequests", device->bandwidth->numIsocRequests);
+		g_string_append_c (json, '}');
+	} else {
+		g_string_append (json, "null");
+	}
+
+	g_string_append (json, ",\"configs\":[");
+	for (i = 0; i < device->configCount; ++i) {
+		if (i)
+			g_string_append_c (json, ',');
+		JSONConfig (json, device->config[i]);
+	}
+	g_string_append (json, "]}\n");
+}
+
+/* write each device out as soon as its line is built, so only one line is ever held */
+static void DumpJSON (GString *json, const struct Device *device)
+{
+	int i;
+
+	for (i = 0; i < device->childCount; ++i) {
+		JSONDevice (json, device->child[i]);
+		fwrite (json->str, 1, json->len, stdout);
+
+		DumpJSON (json, device->child[i]);
+	}
+}
+
+/* the live devices, or the ones saved in "filename" if there is one */
+static struct UsbSnapshot *DumpSnapshot (const gchar *filename)
+{
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+	gchar *text;
+
+	if (filename == NULL)
+		snapshot = usb_snapshot_scan (NULL, NULL, &error);
+	else
+		snapshot = usb_snapshot_load (filename, &error);
+	if (snapshot == NULL) {
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	/* --stats, on stderr so it never gets mixed up with the devices */
+	if (usb_get_scan_stats ()) {
+		text = DescribeScanStats (&snapshot->stats);
+		fprintf (stderr, "Scan statistics for %s:\n%s\n",
+			 filename ? filename : usb_sysfs_devices_dir (), text);
+		g_free (text);
+	}
+
+	return snapshot;
+}
+
+int DumpUSBTree (enum DumpFormat format, const gchar *snapshotFile)
+{
+	struct UsbSnapshot *snapshot;
+	gint64  start;
+	gint64  scanned;
+
+	/* stdout may well be a terminal, but line by line is far too slow here */
+	setvbuf (stdout, NULL, _IOFBF, DUMP_BUFFER_SIZE);
+	g_log_set_default_handler (DumpLog, NULL);
+
+	start = g_get_monotonic_time ();
+	snapshot = DumpSnapshot (snapshotFile);
+	if (snapshot == NULL)
+		return 1;
+	scanned = g_get_monotonic_time ();
+
+	if (format == DUMP_JSON) {
+		GString *json = g_string_sized_new (4096);
+
+		DumpJSON (json, snapshot->root);
+		g_string_free (json, TRUE);
+	} else {
+		DumpTree (snapshot->root, 0);
+		DumpDetails (snapshot->root);
+	}
+	usb_snapshot_unref (snapshot);
+
+	if (fflush (stdout) != 0 || ferror (stdout)) {
+		fprintf (stderr, "Can't write the devices out: %s\n", g_strerror (errno));
+		return 1;
+	}
+
+	g_debug ("dump read in %" G_GINT64_FORMAT " us, printed in %" G_GINT64_FORMAT " us",
+		 scanned - start, g_get_monotonic_time () - scanned);
+
+	return 0;
+}
+
+/* "1d6b:0002" into its vendor and product ids */
+static gboolean ParseId (const gchar *id, gint *vendorId, gint *productId)
+{
+	guint64 vendor;
+	guint64 product;
+	gchar *end;
+
+	vendor = g_ascii_strtoull (id, &end, 16);
+	if ((end == id) || (*end != ':') || (vendor > 0xffff))
+		return FALSE;
+
+	id = end + 1;
+	product = g_ascii_strtoull (id, &end, 16);
+	if ((end == id) || (*end != 0x00) || (product > 0xffff))
+		return FALSE;
+
+	*vendorId = vendor;
+	*productId = product;
+	return TRUE;
+}
+
+/*
+ * Print the details of just the devices with the vendor:product "id", or
+ * the serial number "serial", or both.  They are looked up in the
+ * snapshot's indexes, so only the devices printed are ever looked at.
+ * Returns 0 if any were found, 1 if none were, and 2 if the devices could
+ * not be read.
+ */
+int FindUSBDevices (enum DumpFormat format, const gchar *id, const gchar *serial,
+		    const gchar *snapshotFile)
+{
+	struct UsbSnapshot *snapshot;
+	const GPtrArray *devices;
+	const struct Device *device;
+	GString *json = NULL;
+	gint    vendorId;
+	gint    productId;
+	guint   found = 0;
+	guint   i;
+	gchar  *text;
+
+	if ((id != NULL) && !ParseId (id, &vendorId, &productId)) {
+		fprintf (stderr, "%s is not a vendor:product id, like 1d6b:0002\n", id);
+		return 2;
+	}
+
+	setvbuf (stdout, NULL, _IOFBF, DUMP_BUFFER_SIZE);
+	g_log_set_default_handler (DumpLog, NULL);
+
+	snapshot = DumpSnapshot (snapshotFile);
+	if (snapshot == NULL)
+		return 2;
+
+	if (id != NULL)
+		devices = usb_find_devices_by_id (snapshot, vendorId, productId);
+	else
+		devices = usb_find_devices_by_serial (snapshot, serial);
+
+	if (format == DUMP_JSON)
+		json = g_string_sized_new (4096);
+
+	for (i = 0; devices && i < devices->len; ++i) {
+		device = g_ptr_array_index (devices, i);
+		if ((id != NULL) && (serial != NULL) &&
+		    (g_strcmp0 (device->serialNumber, serial) != 0))
+			continue;
+
+		if (json != NULL) {
+			JSONDevice (json, device);
+			fwrite (json->str, 1, json->len, stdout);
+		} else {
+			text = DescribeDevice (device);
+			printf ("%s%s\n", found ? "\n" : "", text);
+			g_free (text);
+		}
+		++found;
+	}
+
+	if (json != NULL)
+		g_string_free (json, TRUE);
+	usb_snapshot_unref (snapshot);
+
+	if (fflush (stdout) != 0 || ferror (stdout)) {
+		fprintf (stderr, "Can't write the devices out: %s\n", g_strerror (errno));
+		return 2;
+	}
+
+	return found ? 0 : 1;
+}
+
+/* Save the devices to a snapshot file, for --load-snapshot to show later */
+int SaveUSBTree (const gchar *filename, const gchar *snapshotFile)
+{
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+	gboolean saved;
+
+	g_log_set_default_handler (DumpLog, NULL);
+
+	snapshot = DumpSnapshot (snapshotFile);
+	if (snapshot == NULL)
+		return 1;
+
+	saved = usb_snapshot_save (snapshot, filename, &error);
+	usb_snapshot_unref (snapshot);
+
+	if (!saved) {
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* one line for each device that changed, then what changed about it */
+static void DumpDiff (struct UsbDiff *diff)
+{
+	const struct UsbDiffEntry *entry;
+	const struct Device *device;
+	gchar **lines;
+	gchar *text;
+	gchar mark;
+	guint i, j;
+
+	for (i = 0; i < diff->entries->len; ++i) {
+		entry = g_ptr_array_index (diff->entries, i);
+		device = entry->newDevice ? entry->newDevice : entry->oldDevice;
+
+		if (entry->flags & USB_DIFF_ADDED)
+			mark = '+';
+		else if (entry->flags & USB_DIFF_REMOVED)
+			mark = '-';
+		else if (entry->flags & USB_DIFF_MOVED)
+			mark = '>';
+		else
+			mark = '~';
+		printf ("%c %s %s (%04x:%04x)\n", mark, device->sysfsName,
+			device->name ? device->name : "", device->vendorId, device->productId);
+
+		text = usb_diff_describe (entry);
+		lines = g_strsplit (text, "\n", -1);
+		for (j = 0; lines[j] != NULL; ++j)
+			printf ("\t%s\n", lines[j]);
+		g_strfreev (lines);
+		g_free (text);
+	}
+}
+
+/*
+ * Print what changed from the devices saved in "oldFile" to the ones in
+ * "snapshotFile", or to the live ones.  Like diff(1), this returns 0 if
+ * nothing changed, 1 if something did, and 2 if it could not tell.
+ */
+int DiffUSBTree (const gchar *oldFile, const gchar *snapshotFile)
+{
+	struct UsbSnapshot *oldSnapshot;
+	struct UsbSnapshot *newSnapshot;
+	struct UsbDiff *diff;
+	int result;
+
+	setvbuf (stdout, NULL, _IOFBF, DUMP_BUFFER_SIZE);
+	g_log_set_default_handler (DumpLog, NULL);
+
+	oldSnapshot = DumpSnapshot (oldFile);
+	if (oldSnapshot == NULL)
+		return 2;
+	newSnapshot = DumpSnapshot (snapshotFile);
+	if (newSnapshot == NULL) {
+		usb_snapshot_unref (oldSnapshot);
+		return 2;
+	}
+
+	diff = usb_diff_new (oldSnapshot, newSnapshot);
+	DumpDiff (diff);
+	result = diff->entries->len ? 1 : 0;
+
+	usb_diff_free (diff);
+	usb_snapshot_unref (newSnapshot);
+	usb_snapshot_unref (oldSnapshot);
+
+	if (fflush (stdout) != 0 || ferror (stdout)) {
+		fprintf (stderr, "Can't write the changes out: %s\n", g_strerror (errno));
+		return 2;
+	}
+
+	return result;
+}
+
+
+/* Copy the sysfs files the devices are read from into a tar file */
+int CaptureUSBTree (const gchar *filename)
+{
+	GError *error = NULL;
+	guint entries;
+
+	g_log_set_default_handler (DumpLog, NULL);
+
+	if (!usb_sysfs_capture (filename, &entries, &error)) {
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	g_debug ("captured %u files and directories to %s", entries, filename);
+	return 0;
+}
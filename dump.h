@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * dump.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, greg@kroah.com
+ */
+#ifndef __DUMP_H
+#define __DUMP_H
+
+enum DumpFormat {
+	DUMP_TEXT,	/* the tree, then the details of each device */
+	DUMP_JSON,	/* one JSON object per device, per line */
+};
+
+int DumpUSBTree (enum DumpFormat format, const gchar *snapshotFile);
+int FindUSBDevices (enum DumpFormat format, const gchar *id, const gchar *serial,
+		    const gchar *snapshotFile);
+int SaveUSBTree (const gchar *filename, const gchar *snapshotFile);
+int DiffUSBTree (const gchar *oldFile, const gchar *snapshotFile);
+int CaptureUSBTree (const gchar *filename);
+
+#endif	/* __DUMP_H */
@@ -16,7 +16,7 @@
 #include "hicolor/64x64/apps/usbview_icon.xpm"
 
 GtkWidget *treeUSB;
-GtkTreeStore *treeStore;
+UsbTreeModel *treeModel;
 GtkTextBuffer *textDescriptionBuffer;
 GtkWidget *textDescriptionView;
 GtkWidget *windowMain;
@@ -34,6 +34,7 @@ create_windowMain ()
 	GtkWidget *buttonRefresh;
 	GtkWidget *buttonClose;
 	GtkWidget *buttonAbout;
+	GtkWidget *buttonStats;
 	GdkPixbuf *icon;
 	GtkCellRenderer *treeRenderer;
 
@@ -55,18 +56,15 @@ create_windowMain ()
 	gtk_widget_show (hpaned1);
 	gtk_box_pack_start (GTK_BOX (vbox1), hpaned1, TRUE, TRUE, 0);
 
-	treeStore = gtk_tree_store_new (N_COLUMNS,
-				G_TYPE_STRING,	/* NAME_COLUMN */
-				G_TYPE_INT,	/* DEVICE_ADDR_COLUMN */
-				G_TYPE_STRING,	/* COLOR_COLUMN */
-				G_TYPE_STRING	/* TOOLTIP_COLUMN */);
-	treeUSB = gtk_tree_view_new_with_model (GTK_TREE_MODEL (treeStore));
+	treeModel = usb_tree_model_new ();
+	treeUSB = gtk_tree_view_new_with_model (GTK_TREE_MODEL (treeModel));
 	treeRenderer = gtk_cell_renderer_text_new ();
 	treeColumn = gtk_tree_view_column_new_with_attributes (
 					"USB devices",
 					treeRenderer,
 					"text", NAME_COLUMN,
 					"foreground", COLOR_COLUMN,
+					"cell-background", HIGHLIGHT_COLUMN,
 					NULL);
 	gtk_tree_view_append_column (GTK_TREE_VIEW (treeUSB), treeColumn);
 	gtk_tree_view_set_tooltip_column(
@@ -107,6 +105,13 @@ create_windowMain ()
 	gtk_container_set_border_width (GTK_CONTAINER (buttonRefresh), 4);
 	gtk_widget_set_can_default (buttonRefresh, TRUE);
 
+	buttonStats = gtk_button_new_with_label("Statistics");
+	gtk_widget_set_name (buttonStats, "buttonStats");
+	gtk_widget_show (buttonStats);
+	gtk_container_add (GTK_CONTAINER (hbuttonbox1), buttonStats);
+	gtk_container_set_border_width (GTK_CONTAINER (buttonStats), 4);
+	gtk_widget_set_can_default (buttonStats, TRUE);
+
 	buttonAbout = gtk_button_new_with_label("About");
 	gtk_widget_set_name (buttonAbout, "buttonAbout");
 	gtk_widget_show (buttonAbout);
@@ -127,6 +132,9 @@ create_windowMain ()
 	g_signal_connect (G_OBJECT (buttonRefresh), "clicked",
 			    G_CALLBACK (on_buttonRefresh_clicked),
 			    NULL);
+	g_signal_connect (G_OBJECT (buttonStats), "clicked",
+			    G_CALLBACK (on_buttonStats_clicked),
+			    NULL);
 	g_signal_connect (G_OBJECT (buttonAbout), "clicked",
 			    G_CALLBACK (on_buttonAbout_clicked),
 			    NULL);
@@ -9,15 +9,84 @@
 
 #include <stdlib.h>
 
+/*
+ * usbview-dump is built from this file too, with USBVIEW_DUMP_ONLY set.
+ * It only has the modes that print or save the devices, so it is not
+ * linked against GTK at all, and starts up without loading any of it.
+ */
+#ifdef USBVIEW_DUMP_ONLY
+#include <glib.h>
+#else
 #include <gtk/gtk.h>
 
 #include "usbtree.h"
+#include "uevent.h"
+#endif
 
-int main (int argc, char *argv[])
+#include "sysfs.h"
+#include "dump.h"
+
+static gint scanThreads = 0;
+static gboolean dump = FALSE;
+static gboolean json = FALSE;
+static gchar *saveSnapshot = NULL;
+static gchar *loadSnapshot = NULL;
+static gchar *diffSnapshot = NULL;
+#ifndef USBVIEW_DUMP_ONLY
+static gint hotplugWindow = -1;
+#endif
+static gchar *sysfsRoot = NULL;
+static gchar *captureFile = NULL;
+static gboolean scanStats = FALSE;
+static gint bandwidthThreshold = -1;
+static gchar *findId = NULL;
+static gchar *findSerial = NULL;
+
+static GOptionEntry entries[] = {
+	{ "scan-threads", 0, 0, G_OPTION_ARG_INT, &scanThreads,
+	  "Number of threads used to scan the devices (0 for one per CPU)", "N" },
+	{ "dump", 0, 0, G_OPTION_ARG_NONE, &dump,
+	  "Print the devices to stdout instead of opening a window", NULL },
+	{ "json", 0, 0, G_OPTION_ARG_NONE, &json,
+	  "Print the devices to stdout as JSON, one device per line", NULL },
+	{ "id", 0, 0, G_OPTION_ARG_STRING, &findId,
+	  "Only print the devices with this vendor and product id", "VID:PID" },
+	{ "serial", 0, 0, G_OPTION_ARG_STRING, &findSerial,
+	  "Only print the devices with this serial number", "SERIAL" },
+	{ "save-snapshot", 0, 0, G_OPTION_ARG_FILENAME, &saveSnapshot,
+	  "Save the devices to FILE instead of opening a window", "FILE" },
+	{ "load-snapshot", 0, 0, G_OPTION_ARG_FILENAME, &loadSnapshot,
+	  "Show the devices saved in FILE instead of the ones plugged in", "FILE" },
+	{ "diff", 0, 0, G_OPTION_ARG_FILENAME, &diffSnapshot,
+	  "Print what changed since the devices were saved in FILE", "FILE" },
+#ifndef USBVIEW_DUMP_ONLY
+	{ "hotplug-window", 0, 0, G_OPTION_ARG_INT, &hotplugWindow,
+	  "Collect hotplug events for MS milliseconds before updating the tree", "MS" },
+#endif
+	{ "sysfs-root", 0, 0, G_OPTION_ARG_FILENAME, &sysfsRoot,
+	  "Read the devices from the sysfs tree in DIR instead of /sys", "DIR" },
+	{ "capture", 0, 0, G_OPTION_ARG_FILENAME, &captureFile,
+	  "Copy the sysfs files of the devices to FILE, a tar archive", "FILE" },
+	{ "stats", 0, 0, G_OPTION_ARG_NONE, &scanStats,
+	  "Print what every scan of the devices took to stderr", NULL },
+	{ "bandwidth-threshold", 0, 0, G_OPTION_ARG_INT, &bandwidthThreshold,
+	  "Flag buses with more than PERCENT of their periodic bandwidth reserved", "PERCENT" },
+	{ NULL }
+};
+
+#ifndef USBVIEW_DUMP_ONLY
+static int ShowUSBTree (int argc, char *argv[])
 {
 	GtkWidget *window1;
+	GError *error = NULL;
 
-	gtk_init (&argc, &argv);
+	if (!gtk_init_with_args (&argc, &argv, NULL, entries, NULL, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	usb_set_scan_threads (scanThreads);
 
 	initialize_stuff();
 
@@ -29,8 +98,87 @@ int main (int argc, char *argv[])
 	window1 = create_windowMain ();
 	gtk_widget_show (window1);
 
-	LoadUSBTree(0);
+	if (loadSnapshot != NULL) {
+		if (!LoadUSBSnapshot (loadSnapshot, &error)) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+			return 1;
+		}
+	} else {
+		LoadUSBTree(0);
+
+		/*
+		 * Keep the tree up to date as devices come and go.  The kernel
+		 * only tells us about the real /sys, so not for any other tree.
+		 */
+		if (hotplugWindow >= 0)
+			usb_uevent_set_window (hotplugWindow);
+		if (sysfsRoot == NULL)
+			usb_uevent_init();
+	}
+
 	gtk_main ();
 	return 0;
 }
+#endif
+
+int main (int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+
+	/*
+	 * Look for our own options before GTK gets to see anything, so that
+	 * --dump never has to bring up GTK, or need a display at all.  The
+	 * GTK options, and --help, are left alone for gtk_init_with_args().
+	 */
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, entries, NULL);
+#ifndef USBVIEW_DUMP_ONLY
+	g_option_context_set_help_enabled (context, FALSE);
+	g_option_context_set_ignore_unknown_options (context, TRUE);
+#endif
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	usb_set_sysfs_root (sysfsRoot);
+	usb_set_scan_stats (scanStats);
+	if (bandwidthThreshold >= 0)
+		usb_set_bandwidth_threshold (bandwidthThreshold);
 
+	if (captureFile)
+		return CaptureUSBTree (captureFile);
+
+	if (saveSnapshot) {
+		usb_set_scan_threads (scanThreads);
+		return SaveUSBTree (saveSnapshot, loadSnapshot);
+	}
+
+	if (diffSnapshot) {
+		usb_set_scan_threads (scanThreads);
+		return DiffUSBTree (diffSnapshot, loadSnapshot);
+	}
+
+	if (findId || findSerial) {
+		usb_set_scan_threads (scanThreads);
+		return FindUSBDevices (json ? DUMP_JSON : DUMP_TEXT, findId, findSerial,
+				       loadSnapshot);
+	}
+
+	if (dump || json) {
+		usb_set_scan_threads (scanThreads);
+		return DumpUSBTree (json ? DUMP_JSON : DUMP_TEXT, loadSnapshot);
+	}
+
+#ifdef USBVIEW_DUMP_ONLY
+	/* there is no window to open, so print the devices by default */
+	usb_set_scan_threads (scanThreads);
+	return DumpUSBTree (DUMP_TEXT, loadSnapshot);
+#else
+	return ShowUSBTree (argc, argv);
+#endif
+}
@@ -0,0 +1,645 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * snapshot.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Saving a snapshot of the device tree to a file, and loading it back.
+ *
+ * The file is a header, then one table of fixed size records each for the
+ * devices, the lists of children, the configs, the interfaces and the
+ * endpoints, and last all of the strings.  Records refer to each other by
+ * their index in a table, and to strings by their offset in the string
+ * table, so a file means the same wherever it ends up mapped, and every
+ * string is in there only once no matter how many devices use it.  All
+ * numbers are 32 bit little endian.
+ *
+ * The devices are stored breadth first, with the invisible root of the
+ * tree as device 0, so children always come after their parent.
+ *
+ * Loading maps the file and points the tree straight into it: no string
+ * is copied, and all the devices, configs, interfaces and endpoints are
+ * set up in one array each, not allocated one by one.
+ */
+
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "arena.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC		"USBVSNAP"
+#define SNAPSHOT_VERSION	1
+
+/* a string offset for a NULL string */
+#define SNAPSHOT_NO_STRING	0xffffffff
+
+/* USB allows seven tiers, and the root hubs are the first one, at level 0 */
+#define SNAPSHOT_MAX_LEVEL	6
+
+struct snapshot_table {
+	guint32	offset;		/* from the start of the file */
+	guint32	count;		/* records, or bytes for the strings */
+};
+
+struct snapshot_header {
+	gchar	magic[8];
+	guint32	version;
+	guint32	size;		/* of the whole file */
+	struct snapshot_table	devices;
+	struct snapshot_table	children;
+	struct snapshot_table	configs;
+	struct snapshot_table	interfaces;
+	struct snapshot_table	endpoints;
+	struct snapshot_table	strings;
+};
+
+struct snapshot_device {
+	guint32	name;
+	guint32	sysfsName;
+	guint32	version;
+	guint32	class;
+	guint32	subClass;
+	guint32	protocol;
+	guint32	revisionNumber;
+	guint32	manufacturer;
+	guint32	product;
+	guint32	serialNumber;
+	guint32	busNumber;
+	guint32	level;
+	guint32	portNumber;
+	guint32	connectorNumber;
+	guint32	deviceNumber;
+	guint32	speed;
+	guint32	maxChildren;
+	guint32	maxPacketSize;
+	guint32	numConfigs;
+	guint32	vendorId;
+	guint32	productId;
+	guint32	parent;		/* device index, 0 for the root itself */
+	guint32	firstChild;	/* in the children table, which holds device indexes */
+	guint32	childCount;
+	guint32	firstConfig;
+	guint32	configCount;
+	guint32	hasBandwidth;
+	guint32	allocated;
+	guint32	total;
+	guint32	percent;
+	guint32	numInterruptRequests;
+	guint32	numIsocRequests;
+};
+
+struct snapshot_config {
+	guint32	configNumber;
+	guint32	numInterfaces;
+	guint32	attributes;
+	guint32	maxPower;
+	guint32	active;
+	guint32	firstInterface;
+	guint32	interfaceCount;
+};
+
+struct snapshot_interface {
+	guint32	name;
+	guint32	interfaceNumber;
+	guint32	alternateNumber;
+	guint32	numEndpoints;
+	guint32	subClass;
+	guint32	protocol;
+	guint32	class;
+	guint32	firstEndpoint;
+	guint32	endpointCount;
+	guint32	driverAttached;
+	guint32	active;
+};
+
+struct snapshot_endpoint {
+	guint32	address;
+	guint32	in;
+	guint32	attribute;
+	guint32	type;
+	guint32	maxPacketSize;
+	guint32	interval;
+};
+
+#define PUT(value)	GUINT32_TO_LE ((guint32)(value))
+#define GET(value)	GUINT32_FROM_LE (value)
+
+
+/* everything a save collects before the file is written */
+struct save {
+	GPtrArray	*devices;	/* breadth first, so also the queue */
+	GArray		*deviceTable;
+	GArray		*children;
+	GArray		*configs;
+	GArray		*interfaces;
+	GArray		*endpoints;
+	GString		*strings;
+	GHashTable	*stringOffsets;	/* string -> offset + 1 */
+};
+
+static guint32 save_string (struct save *save, const gchar *string)
+{
+	guint32 offset;
+
+	if (string == NULL)
+		return PUT (SNAPSHOT_NO_STRING);
+
+	offset = GPOINTER_TO_UINT (g_hash_table_lookup (save->stringOffsets, string));
+	if (offset == 0) {
+		offset = save->strings->len + 1;
+		g_string_append_len (save->strings, string, strlen (string) + 1);
+		g_hash_table_insert (save->stringOffsets, (gpointer)string,
+				     GUINT_TO_POINTER (offset));
+	}
+	return PUT (offset - 1);
+}
+
+static void save_interface (struct save *save, const struct DeviceInterface *interface)
+{
+	struct snapshot_interface record;
+	int i;
+
+	record.name		= save_string (save, interface->name);
+	record.interfaceNumber	= PUT (interface->interfaceNumber);
+	record.alternateNumber	= PUT (interface->alternateNumber);
+	record.numEndpoints	= PUT (interface->numEndpoints);
+	record.subClass		= PUT (interface->subClass);
+	record.protocol		= PUT (interface->protocol);
+	record.class		= save_string (save, interface->class);
+	record.firstEndpoint	= PUT (save->endpoints->len);
+	record.endpointCount	= PUT (interface->endpointCount);
+	record.driverAttached	= PUT (interface->driverAttached);
+	record.active		= PUT (interface->active);
+	g_array_append_val (save->interfaces, record);
+
+	for (i = 0; i < interface->endpointCount; ++i) {
+		const struct DeviceEndpoint *endpoint = interface->endpoint[i];
+		struct snapshot_endpoint entry;
+
+		entry.address		= PUT (endpoint->address);
+		entry.in		= PUT (endpoint->in);
+		entry.attribute		= PUT (endpoint->attribute);
+		entry.type		= save_string (save, endpoint->type);
+		entry.maxPacketSize	= PUT (endpoint->maxPacketSize);
+		entry.interval		= save_string (save, endpoint->interval);
+		g_array_append_val (save->endpoints, entry);
+	}
+}
+
+static void save_config (struct save *save, const struct DeviceConfig *config)
+{
+	struct snapshot_config record;
+	int i;
+
+	record.configNumber	= PUT (config->configNumber);
+	record.numInterfaces	= PUT (config->numInterfaces);
+	record.attributes	= PUT (config->attributes);
+	record.maxPower		= save_string (save, config->maxPower);
+	record.active		= PUT (config->active);
+	record.firstInterface	= PUT (save->interfaces->len);
+	record.interfaceCount	= PUT (config->interfaceCount);
+	g_array_append_val (save->configs, record);
+
+	/* the interfaces of one config have to be next to each other */
+	for (i = 0; i < config->interfaceCount; ++i)
+		save_interface (save, config->interface[i]);
+}
+
+static void save_device (struct save *save, const struct Device *device,
+			 guint32 parent)
+{
+	struct snapshot_device record;
+	const struct DeviceBandwidth *bandwidth = device->bandwidth;
+	int i;
+
+	memset (&record, 0x00, sizeof(record));
+	record.name		= save_string (save, device->name);
+	record.sysfsName	= save_string (save, device->sysfsName);
+	record.version		= save_string (save, device->version);
+	record.class		= save_string (save, device->class);
+	record.subClass		= save_string (save, device->subClass);
+	record.protocol		= save_string (save, device->protocol);
+	record.revisionNumber	= save_string (save, device->revisionNumber);
+	record.manufacturer	= save_string (save, device->manufacturer);
+	record.product		= save_string (save, device->product);
+	record.serialNumber	= save_string (save, device->serialNumber);
+	record.busNumber	= PUT (device->busNumber);
+	record.level		= PUT (device->level);
+	record.portNumber	= PUT (device->portNumber);
+	record.connectorNumber	= PUT (device->connectorNumber);
+	record.deviceNumber	= PUT (device->deviceNumber);
+	record.speed		= PUT (device->speed);
+	record.maxChildren	= PUT (device->maxChildren);
+	record.maxPacketSize	= PUT (device->maxPacketSize);
+	record.numConfigs	= PUT (device->numConfigs);
+	record.vendorId		= PUT (device->vendorId);
+	record.productId	= PUT (device->productId);
+	record.parent		= PUT (parent);
+	record.firstChild	= PUT (save->children->len);
+	record.childCount	= PUT (device->childCount);
+	record.firstConfig	= PUT (save->configs->len);
+	record.configCount	= PUT (device->configCount);
+	if (bandwidth != NULL) {
+		record.hasBandwidth		= PUT (TRUE);
+		record.allocated		= PUT (bandwidth->allocated);
+		record.total			= PUT (bandwidth->total);
+		record.percent			= PUT (bandwidth->percent);
+		record.numInterruptRequests	= PUT (bandwidth->numInterruptRequests);
+		record.numIsocRequests		= PUT (bandwidth->numIsocRequests);
+	}
+	g_array_append_val (save->deviceTable, record);
+
+	/* the children get the next free indexes, and are saved once we get to them */
+	for (i = 0; i < device->childCount; ++i) {
+		guint32 child = PUT (save->devices->len);
+
+		g_array_append_val (save->children, child);
+		g_ptr_array_add (save->devices, device->child[i]);
+	}
+
+	for (i = 0; i < device->configCount; ++i)
+		save_config (save, device->config[i]);
+}
+
+static void save_table (GByteArray *file, struct snapshot_table *table,
+			GArray *records, gsize recordSize)
+{
+	table->offset = PUT (file->len);
+	table->count = PUT (records->len);
+	g_byte_array_append (file, (const guint8 *)records->data, records->len * recordSize);
+}
+
+/*
+ * Write a snapshot out to a file, replacing whatever was there.  The file
+ * is written in one go, so a reader never sees half of it.
+ */
+gboolean usb_snapshot_save (struct UsbSnapshot *snapshot, const gchar *filename,
+			    GError **error)
+{
+	struct snapshot_header header;
+	struct save save;
+	GArray *parents;
+	GByteArray *file;
+	gboolean result;
+	guint32 parent;
+	guint i;
+
+	save.devices = g_ptr_array_new ();
+	save.deviceTable = g_array_new (FALSE, FALSE, sizeof(struct snapshot_device));
+	save.children = g_array_new (FALSE, FALSE, sizeof(guint32));
+	save.configs = g_array_new (FALSE, FALSE, sizeof(struct snapshot_config));
+	save.interfaces = g_array_new (FALSE, FALSE, sizeof(struct snapshot_interface));
+	save.endpoints = g_array_new (FALSE, FALSE, sizeof(struct snapshot_endpoint));
+	save.strings = g_string_sized_new (4096);
+	save.stringOffsets = g_hash_table_new (g_str_hash, g_str_equal);
+	parents = g_array_new (FALSE, FALSE, sizeof(guint32));
+
+	/* walk the tree breadth first, the list of devices is the queue */
+	g_ptr_array_add (save.devices, snapshot->root);
+	parent = 0;
+	g_array_append_val (parents, parent);
+	for (i = 0; i < save.devices->len; ++i) {
+		const struct Device *device = g_ptr_array_index (save.devices, i);
+		guint first = save.devices->len;
+		guint j;
+
+		save_device (&save, device, g_array_index (parents, guint32, i));
+		for (j = first; j < save.devices->len; ++j) {
+			parent = i;
+			g_array_append_val (parents, parent);
+		}
+	}
+
+	memset (&header, 0x00, sizeof(header));
+	memcpy (header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = PUT (SNAPSHOT_VERSION);
+
+	file = g_byte_array_sized_new (sizeof(header) +
+				       save.deviceTable->len * sizeof(struct snapshot_device) +
+				       save.strings->len);
+	g_byte_array_append (file, (const guint8 *)&header, sizeof(header));
+	save_table (file, &header.devices, save.deviceTable, sizeof(struct snapshot_device));
+	save_table (file, &header.children, save.children, sizeof(guint32));
+	save_table (file, &header.configs, save.configs, sizeof(struct snapshot_config));
+	save_table (file, &header.interfaces, save.interfaces, sizeof(struct snapshot_interface));
+	save_table (file, &header.endpoints, save.endpoints, sizeof(struct snapshot_endpoint));
+	header.strings.offset = PUT (file->len);
+	header.strings.count = PUT (save.strings->len);
+	g_byte_array_append (file, (const guint8 *)save.strings->str, save.strings->len);
+	header.size = PUT (file->len);
+	memcpy (file->data, &header, sizeof(header));
+
+	result = g_file_set_contents (filename, (const gchar *)file->data, file->len, error);
+
+	g_debug ("saved %u devices in %u bytes, %" G_GSIZE_FORMAT " of them strings",
+		 save.devices->len - 1, file->len, save.strings->len);
+
+	g_byte_array_unref (file);
+	g_array_unref (parents);
+	g_hash_table_destroy (save.stringOffsets);
+	g_string_free (save.strings, TRUE);
+	g_array_unref (save.endpoints);
+	g_array_unref (save.interfaces);
+	g_array_unref (save.configs);
+	g_array_unref (save.children);
+	g_array_unref (save.deviceTable);
+	g_ptr_array_unref (save.devices);
+
+	return result;
+}
+
+
+/* everything a load needs to check the file against */
+struct load {
+	const gchar	*data;
+	gsize		size;
+	const gchar	*strings;
+	guint32		stringsSize;
+	gboolean	bad;		/* set as soon as anything does not add up */
+};
+
+static gboolean load_table (struct load *load, const struct snapshot_table *table,
+			    gsize recordSize)
+{
+	guint64 offset = GET (table->offset);
+	guint64 count = GET (table->count);
+
+	if ((offset % sizeof(guint32)) || (offset + count * recordSize > load->size)) {
+		load->bad = TRUE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static const gchar *load_string (struct load *load, guint32 offset)
+{
+	offset = GET (offset);
+	if (offset == SNAPSHOT_NO_STRING)
+		return NULL;
+	if (offset >= load->stringsSize) {
+		load->bad = TRUE;
+		return NULL;
+	}
+	return load->strings + offset;
+}
+
+/* is first ... first + count - 1 inside a table that holds "size" records */
+static gboolean load_range (struct load *load, guint32 first, guint32 count, guint32 size)
+{
+	if ((guint64)GET (first) + GET (count) > size) {
+		load->bad = TRUE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Open a snapshot that was written by usb_snapshot_save().  The file stays
+ * mapped for as long as the snapshot is around.  Everything in it is
+ * checked before it is used, so a broken file gives an error, not a crash.
+ */
+struct UsbSnapshot *usb_snapshot_load (const gchar *filename, GError **error)
+{
+	const struct snapshot_header *header;
+	const struct snapshot_device *deviceTable;
+	const guint32 *childTable;
+	const struct snapshot_config *configTable;
+	const struct snapshot_interface *interfaceTable;
+	const struct snapshot_endpoint *endpointTable;
+	struct UsbSnapshot *snapshot;
+	struct Device *devices;
+	struct Device **children;
+	struct DeviceConfig *configs;
+	struct DeviceConfig **configList;
+	struct DeviceInterface *interfaces;
+	struct DeviceInterface **interfaceList;
+	struct DeviceEndpoint *endpoints;
+	struct DeviceEndpoint **endpointList;
+	struct DeviceBandwidth *bandwidths;
+	guint32 deviceCount, childCount, configCount, interfaceCount, endpointCount;
+	GMappedFile *file;
+	struct load load;
+	gint64 start;
+	guint32 i, j;
+
+	start = g_get_monotonic_time ();
+
+	file = g_mapped_file_new (filename, FALSE, error);
+	if (file == NULL)
+		return NULL;
+
+	memset (&load, 0x00, sizeof(load));
+	load.data = g_mapped_file_get_contents (file);
+	load.size = g_mapped_file_get_length (file);
+
+	header = (const struct snapshot_header *)load.data;
+	if ((load.size < sizeof(*header)) ||
+	    memcmp (header->magic, SNAPSHOT_MAGIC, sizeof(header->magic))) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is not a usbview snapshot", filename);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+	if (GET (header->version) != SNAPSHOT_VERSION) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is a version %u snapshot, only version %u is known",
+			     filename, GET (header->version), SNAPSHOT_VERSION);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+
+	if ((GET (header->size) != load.size) ||
+	    !load_table (&load, &header->devices, sizeof(struct snapshot_device)) ||
+	    !load_table (&load, &header->children, sizeof(guint32)) ||
+	    !load_table (&load, &header->configs, sizeof(struct snapshot_config)) ||
+	    !load_table (&load, &header->interfaces, sizeof(struct snapshot_interface)) ||
+	    !load_table (&load, &header->endpoints, sizeof(struct snapshot_endpoint)) ||
+	    !load_table (&load, &header->strings, 1) ||
+	    (GET (header->devices.count) == 0) ||
+	    (GET (header->strings.count) == 0) ||
+	    (load.data[GET (header->strings.offset) + GET (header->strings.count) - 1] != '\0')) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is cut short or broken", filename);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+
+	/* the string table ends in a NUL, so every offset into it is a proper string */
+	load.strings = load.data + GET (header->strings.offset);
+	load.stringsSize = GET (header->strings.count);
+
+	deviceTable = (const void *)(load.data + GET (header->devices.offset));
+	childTable = (const void *)(load.data + GET (header->children.offset));
+	configTable = (const void *)(load.data + GET (header->configs.offset));
+	interfaceTable = (const void *)(load.data + GET (header->interfaces.offset));
+	endpointTable = (const void *)(load.data + GET (header->endpoints.offset));
+	deviceCount = GET (header->devices.count);
+	childCount = GET (header->children.count);
+	configCount = GET (header->configs.count);
+	interfaceCount = GET (header->interfaces.count);
+	endpointCount = GET (header->endpoints.count);
+
+	snapshot = usb_snapshot_new ();
+	snapshot->file = file;
+
+	/* one array for each kind of thing, and one for each kind of pointer to them */
+	devices = arena_alloc0 (snapshot->arena, deviceCount * sizeof(*devices));
+	children = arena_alloc0 (snapshot->arena, childCount * sizeof(*children));
+	configs = arena_alloc0 (snapshot->arena, configCount * sizeof(*configs));
+	configList = arena_alloc0 (snapshot->arena, configCount * sizeof(*configList));
+	interfaces = arena_alloc0 (snapshot->arena, interfaceCount * sizeof(*interfaces));
+	interfaceList = arena_alloc0 (snapshot->arena, interfaceCount * sizeof(*interfaceList));
+	endpoints = arena_alloc0 (snapshot->arena, endpointCount * sizeof(*endpoints));
+	endpointList = arena_alloc0 (snapshot->arena, endpointCount * sizeof(*endpointList));
+	bandwidths = arena_alloc0 (snapshot->arena, deviceCount * sizeof(*bandwidths));
+
+	for (i = 0; i < endpointCount; ++i) {
+		const struct snapshot_endpoint *record = &endpointTable[i];
+		struct DeviceEndpoint *endpoint = &endpoints[i];
+
+		endpoint->address	= GET (record->address);
+		endpoint->in		= GET (record->in);
+		endpoint->attribute	= GET (record->attribute);
+		endpoint->type		= load_string (&load, record->type);
+		endpoint->maxPacketSize	= GET (record->maxPacketSize);
+		endpoint->interval	= load_string (&load, record->interval);
+		endpointList[i] = endpoint;
+	}
+
+	for (i = 0; i < interfaceCount; ++i) {
+		const struct snapshot_interface *record = &interfaceTable[i];
+		struct DeviceInterface *interface = &interfaces[i];
+
+		interface->name			= load_string (&load, record->name);
+		interface->interfaceNumber	= GET (record->interfaceNumber);
+		interface->alternateNumber	= GET (record->alternateNumber);
+		interface->numEndpoints		= GET (record->numEndpoints);
+		interface->subClass		= GET (record->subClass);
+		interface->protocol		= GET (record->protocol);
+		interface->class		= load_string (&load, record->class);
+		interface->driverAttached	= GET (record->driverAttached);
+		interface->active		= GET (record->active);
+		if (load_range (&load, record->firstEndpoint, record->endpointCount, endpointCount)) {
+			interface->endpoint = &endpointList[GET (record->firstEndpoint)];
+			interface->endpointCount = GET (record->endpointCount);
+		}
+		interfaceList[i] = interface;
+	}
+
+	for (i = 0; i < configCount; ++i) {
+		const struct snapshot_config *record = &configTable[i];
+		struct DeviceConfig *config = &configs[i];
+
+		config->configNumber	= GET (record->configNumber);
+		config->numInterfaces	= GET (record->numInterfaces);
+		config->attributes	= GET (record->attributes);
+		config->maxPower	= load_string (&load, record->maxPower);
+		config->active		= GET (record->active);
+		if (load_range (&load, record->firstInterface, record->interfaceCount, interfaceCount)) {
+			config->interface = &interfaceList[GET (record->firstInterface)];
+			config->interfaceCount = GET (record->interfaceCount);
+		}
+		configList[i] = config;
+	}
+
+	for (i = 0; i < deviceCount; ++i) {
+		const struct snapshot_device *record = &deviceTable[i];
+		struct Device *device = &devices[i];
+
+		device->name		= load_string (&load, record->name);
+		device->sysfsName	= (gchar *)load_string (&load, record->sysfsName);
+		device->version		= load_string (&load, record->version);
+		device->class		= load_string (&load, record->class);
+		device->subClass	= load_string (&load, record->subClass);
+		device->protocol	= load_string (&load, record->protocol);
+		device->revisionNumber	= load_string (&load, record->revisionNumber);
+		device->manufacturer	= (gchar *)load_string (&load, record->manufacturer);
+		device->product		= (gchar *)load_string (&load, record->product);
+		device->serialNumber	= (gchar *)load_string (&load, record->serialNumber);
+		device->busNumber	= GET (record->busNumber);
+		device->level		= GET (record->level);
+		device->portNumber	= GET (record->portNumber);
+		device->connectorNumber	= GET (record->connectorNumber);
+		device->deviceNumber	= GET (record->deviceNumber);
+		device->speed		= GET (record->speed);
+		device->maxChildren	= GET (record->maxChildren);
+		device->maxPacketSize	= GET (record->maxPacketSize);
+		device->numConfigs	= GET (record->numConfigs);
+		device->vendorId	= GET (record->vendorId);
+		device->productId	= GET (record->productId);
+		device->generation	= snapshot->generation;
+		if (i != 0)
+			device->handle = USB_DEVICE_HANDLE (device->busNumber, device->deviceNumber);
+
+		if (load_range (&load, record->firstConfig, record->configCount, configCount)) {
+			device->config = &configList[GET (record->firstConfig)];
+			device->configCount = GET (record->configCount);
+		}
+
+		if (GET (record->hasBandwidth)) {
+			device->bandwidth = &bandwidths[i];
+			device->bandwidth->allocated = GET (record->allocated);
+			device->bandwidth->total = GET (record->total);
+			device->bandwidth->percent = GET (record->percent);
+			device->bandwidth->numInterruptRequests = GET (record->numInterruptRequests);
+			device->bandwidth->numIsocRequests = GET (record->numIsocRequests);
+		}
+
+		/* everything but the root is looked up and shown by these */
+		if ((i != 0) && ((device->sysfsName == NULL) || (device->name == NULL)))
+			load.bad = TRUE;
+
+		/*
+		 * Children have to come after their parent, say so themselves,
+		 * and have only the one parent, or this would not be a tree.
+		 * They also sit one level below it, the root hubs at level 0,
+		 * and no deeper than USB allows.
+		 */
+		if (!load_range (&load, record->firstChild, record->childCount, childCount))
+			continue;
+		device->child = &children[GET (record->firstChild)];
+		device->childCount = GET (record->childCount);
+		for (j = 0; j < (guint32)device->childCount; ++j) {
+			guint32 child = GET (childTable[GET (record->firstChild) + j]);
+			guint32 level = (i == 0) ? 0 : (guint32)device->level + 1;
+
+			if ((child <= i) || (child >= deviceCount) ||
+			    (GET (deviceTable[child].parent) != i) ||
+			    (GET (deviceTable[child].level) != level) ||
+			    (level > SNAPSHOT_MAX_LEVEL) ||
+			    (devices[child].parent != NULL)) {
+				load.bad = TRUE;
+				device->childCount = 0;
+				break;
+			}
+			devices[child].parent = device;
+			device->child[j] = &devices[child];
+		}
+	}
+
+	/* and every device but the root has to be somebody's child */
+	for (i = 1; i < deviceCount && !load.bad; ++i)
+		if (devices[i].parent == NULL)
+			load.bad = TRUE;
+
+	if (load.bad) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is broken", filename);
+		usb_snapshot_unref (snapshot);
+		return NULL;
+	}
+
+	snapshot->root = &devices[0];
+	usb_snapshot_index (snapshot);
+
+	g_debug ("loaded %u devices from %s in %" G_GINT64_FORMAT " us",
+		 deviceCount - 1, filename, g_get_monotonic_time () - start);
+
+	return snapshot;
+}
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * snapshot.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, greg@kroah.com
+ */
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+struct UsbSnapshot;
+
+gboolean usb_snapshot_save(struct UsbSnapshot *snapshot, const gchar *filename,
+			   GError **error);
+struct UsbSnapshot *usb_snapshot_load(const gchar *filename, GError **error);
+
+#endif	/* __SNAPSHOT_H */
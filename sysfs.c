@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -20,14 +21,32 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <gtk/gtk.h>
+#include <glib.h>
+#include <gio/gio.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 
-#include "usbtree.h"
 #include "sysfs.h"
-#include "ccan/list/list.h"
+#include "arena.h"
+
+#define USB_DEVICES_DIR	"/sys/bus/usb/devices"
+
+/*
+ * Calls to the kernel made by the scan going on, see usb_set_scan_stats().
+ * Only one scan runs at a time, so one set of counters does.
+ */
+static gboolean scanStats;
+static gint scanCalls[USB_SCAN_CALLS];
+
+/* see usb_set_scan_uring() */
+static gboolean scanUring = TRUE;
 
-struct Device *rootDevice = NULL;
-static struct DeviceBandwidth *currentBandwidth = NULL;
+#define SCAN_COUNT(call)						\
+	do {								\
+		if (G_UNLIKELY(scanStats))				\
+			g_atomic_int_inc(&scanCalls[call]);		\
+	} while (0)
 
 
 /* taken from all-io.h from util-linux repo */
@@ -38,6 +57,7 @@ static inline ssize_t read_all(int fd, char *buf, size_t count)
 	int tries = 0;
 
 	while (count > 0) {
+		SCAN_COUNT(USB_SCAN_READS);
 		ret = read(fd, buf, count);
 		if (ret <= 0) {
 			if (ret < 0 && (errno == EAGAIN || errno == EINTR) &&
@@ -55,641 +75,1679 @@ static inline ssize_t read_all(int fd, char *buf, size_t count)
 	return c;
 }
 
-static int openreadclose(const char *filename, char *buffer, size_t bufsize)
+/*
+ * Read a sysfs attribute relative to an already opened directory, as is.
+ * A missing attribute is not an error, the open simply fails, so there is
+ * no need to stat() it first.
+ */
+static ssize_t sysfs_read_raw(int dirfd, const char *filename, char *buffer, size_t bufsize)
 {
 	ssize_t count;
 	int fd;
 
-	fd = openat(0, filename, O_RDONLY);
+	SCAN_COUNT(USB_SCAN_OPENS);
+	fd = openat(dirfd, filename, O_RDONLY | O_CLOEXEC);
 	if (fd < 0) {
-		printf("error opening %s\n", filename);
-		return fd;
+		if (errno == ENODEV)
+			g_debug("%s went away while it was read", filename);
+		else if (errno != ENOENT)
+			g_warning("error opening %s: %s", filename, g_strerror(errno));
+		return -1;
 	}
 
-	count = read_all(fd, buffer, bufsize);
+	count = read_all(fd, buffer, bufsize - 1);
 	if (count < 0) {
-		printf("Error %ld reading from %s\n", count, filename);
+		g_warning("Error %ld reading from %s", (long)count, filename);
 	}
 
 	close(fd);
+
 	return count;
 }
 
-static int check_file_present(const char *filename)
+/* strip the trailing \n off of what was read, and terminate the string */
+static int sysfs_text(char *buffer, ssize_t count)
 {
-	struct stat sb;
-	int retval;
-
-	retval = stat(filename, &sb);
-	if (retval == -1) {
-		//fprintf(stderr,
-		//	"filename %s is not present\n", filename);
-		return retval;
-	}
-
-	if ((sb.st_mode & S_IFMT) != S_IFREG) {
-		fprintf(stderr,
-			"filename %s must be a real file, not anything else.\n",
-			filename);
+	if (count <= 0)
 		return -1;
-	}
-	return 0;
+
+	if (buffer[count-1] == '\n')
+		--count;
+	buffer[count] = 0x00;
+	return count;
 }
 
-static int check_dir_present(const char *filename)
+static int sysfs_read(int dirfd, const char *filename, char *buffer, size_t bufsize)
 {
-	struct stat sb;
-	int retval;
-
-	retval = stat(filename, &sb);
-	if (retval == -1) {
-//		fprintf(stderr,
-//			"filename %s is not present\n", filename);
-		return retval;
-	}
-
-	if ((sb.st_mode & S_IFMT) != S_IFDIR) {
-		fprintf(stderr,
-			"filename %s must be a directory, not anything else.\n",
-			filename);
-		return -1;
-	}
-	return 0;
+	return sysfs_text(buffer, sysfs_read_raw(dirfd, filename, buffer, bufsize));
 }
 
-static char *sysfs_string(const char *directory, const char *filename)
+static int sysfs_int(int dirfd, const char *filename, int base)
 {
-	char full_filename[PATH_MAX];
-	char buffer[256];
-	char *temp;
-	int retval;
+	char buffer[64];
 
-	snprintf(full_filename, PATH_MAX, "%s/%s", directory, filename);
+	if (sysfs_read(dirfd, filename, buffer, sizeof(buffer)) < 0)
+		return 0;
 
-	if (check_file_present(full_filename))
-		return NULL;
+	return strtol(buffer, NULL, base);
+}
+
+/* one attribute of a batch read, see sysfs_read_batch() */
+struct sysfs_attr {
+	const char	*name;
+	char		*buffer;
+	size_t		size;		/* at most size - 1 bytes are read */
+	ssize_t		length;		/* what was read, or -1 */
+};
 
-	retval = openreadclose(full_filename, buffer, sizeof(buffer));
-	if (retval <= 0)
+static char *sysfs_attr_string(struct arena *arena, struct sysfs_attr *attr)
+{
+	if (sysfs_text(attr->buffer, attr->length) < 0)
 		return NULL;
 
-	/* strip trailing \n off */
-	buffer[retval-1] = 0x00;
-	temp = g_strdup(buffer);
-	return temp;
+	return arena_strdup(arena, attr->buffer);
 }
 
-static int sysfs_int(const char *dir, const char *filename, int base)
+static int sysfs_attr_int(struct sysfs_attr *attr, int base)
 {
-	char *string = sysfs_string(dir, filename);
-
-	if (!string)
+	if (sysfs_text(attr->buffer, attr->length) < 0)
 		return 0;
 
-	int value = strtol(string, NULL, base);
-
-	g_free(string);
-	return value;
+	return strtol(attr->buffer, NULL, base);
 }
 
-static void DestroyEndpoint (struct DeviceEndpoint *endpoint)
-{
-	if (endpoint == NULL)
-		return;
+#ifdef HAVE_LIBURING
+/* most attributes one batch can read, each one uses a fixed file slot */
+#define URING_BATCH	16
 
-	g_free (endpoint->type);
-	g_free (endpoint->interval);
+/* each thread doing scans has its own ring */
+struct uring {
+	struct io_uring	ring;
+	gboolean	usable;
+};
 
-	g_free (endpoint);
+static void uring_free(gpointer data)
+{
+	struct uring *uring = data;
 
-	return;
+	if (uring->usable)
+		io_uring_queue_exit(&uring->ring);
+	g_free(uring);
 }
 
+static GPrivate uringPrivate = G_PRIVATE_INIT(uring_free);
 
-static void DestroyInterface (struct DeviceInterface *interface)
-{
-	int     i;
-
-	if (interface == NULL)
-		return;
+/* set once the kernel turned io_uring down, so we stop asking */
+static gint uringBroken;
 
-	for (i = 0; i < MAX_ENDPOINTS; ++i)
-		DestroyEndpoint (interface->endpoint[i]);
+static struct io_uring *uring_get(void)
+{
+	struct uring *uring;
 
-	g_free (interface->name);
-	g_free (interface->class);
+	if (!scanUring || g_atomic_int_get(&uringBroken))
+		return NULL;
 
-	g_free (interface);
+	uring = g_private_get(&uringPrivate);
+	if (uring == NULL) {
+		uring = g_malloc0(sizeof(*uring));
+		if (io_uring_queue_init(URING_BATCH * 3, &uring->ring, 0) == 0) {
+			if (io_uring_register_files_sparse(&uring->ring, URING_BATCH) == 0)
+				uring->usable = TRUE;
+			else
+				io_uring_queue_exit(&uring->ring);
+		}
+		if (!uring->usable)
+			g_atomic_int_set(&uringBroken, 1);
+		g_private_set(&uringPrivate, uring);
+	}
 
-	return;
+	return uring->usable ? &uring->ring : NULL;
 }
 
+/*
+ * Throw this thread's ring away, along with anything still queued up on
+ * it, and start over with a new one for the next batch.
+ */
+static void uring_reset(void)
+{
+	g_private_replace(&uringPrivate, NULL);
+}
 
-static void DestroyConfig (struct DeviceConfig *config)
+/*
+ * Queue an open, read and close for every attribute, and wait for all of
+ * them with a single system call.  The files are opened into the ring's
+ * own file table, so the read can be linked right after the open.
+ */
+static int sysfs_read_batch_uring(struct io_uring *ring, int dirfd,
+				  struct sysfs_attr *attrs, int count)
 {
-	int     i;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	uint64_t data;
+	int submitted;
+	int seen;
+	int ret;
+	int i;
 
-	if (config == NULL)
-		return;
+	for (i = 0; i < count; ++i) {
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_openat_direct(sqe, dirfd, attrs[i].name, O_RDONLY, 0, i);
+		io_uring_sqe_set_data64(sqe, (uint64_t)i << 2 | 0);
+		sqe->flags |= IOSQE_IO_LINK;
 
-	for (i = 0; i < MAX_INTERFACES; ++i)
-		DestroyInterface (config->interface[i]);
+		/* the close has to happen even if the read fails */
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_read(sqe, i, attrs[i].buffer, attrs[i].size - 1, 0);
+		io_uring_sqe_set_data64(sqe, (uint64_t)i << 2 | 1);
+		sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
 
-	g_free (config->maxPower);
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_close_direct(sqe, i);
+		io_uring_sqe_set_data64(sqe, (uint64_t)i << 2 | 2);
 
-	g_free (config);
+		attrs[i].length = -1;
+	}
 
-	return;
-}
+	/*
+	 * The buffers are on our caller's stack, so every request that went
+	 * in has to be waited for before going back, even if reading failed.
+	 * This is the only system call, so it counts as the one read.
+	 */
+	SCAN_COUNT(USB_SCAN_READS);
+	submitted = io_uring_submit_and_wait(ring, count * 3);
+	if (submitted < 0)
+		submitted = 0;
+
+	for (seen = 0; seen < submitted; ) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret == -EINTR)
+			continue;
+		if (ret < 0)
+			break;
+
+		++seen;
+		data = io_uring_cqe_get_data64(cqe);
+		switch (data & 0x03) {
+		case 0:
+			if (cqe->res == -ENODEV)
+				g_debug("%s went away while it was read",
+					attrs[data >> 2].name);
+			else if (cqe->res < 0 && cqe->res != -ENOENT)
+				g_warning("error opening %s: %s", attrs[data >> 2].name,
+					  g_strerror(-cqe->res));
+			break;
+		case 1:
+			if (cqe->res >= 0)
+				attrs[data >> 2].length = cqe->res;
+			break;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
 
+	/*
+	 * Requests that did not go in would go in with the next batch, so
+	 * the ring is no good any more.  If the wait failed, tearing the
+	 * ring down is the only way left to cancel what is still running.
+	 */
+	if (seen < count * 3) {
+		uring_reset();
+		return -1;
+	}
 
-static void DestroyBandwidth (struct DeviceBandwidth *bandwidth)
-{
-	/* nothing dynamic in the bandwidth structure yet. */
-	return;
+	return 0;
 }
+#endif
 
-static void DestroyDevice(struct Device *device)
+/*
+ * Read a bunch of attributes from the same directory.  With io_uring all
+ * of them are read with one system call, otherwise one at a time.
+ */
+static void sysfs_read_batch(int dirfd, struct sysfs_attr *attrs, int count)
 {
-	int     i;
+	int i;
 
-	if (device == NULL)
+#ifdef HAVE_LIBURING
+	struct io_uring *ring = uring_get();
+
+	if (ring && count <= URING_BATCH &&
+	    sysfs_read_batch_uring(ring, dirfd, attrs, count) == 0)
 		return;
+#endif
 
-	for (i = 0; i < MAX_CHILDREN; ++i)
-		DestroyDevice (device->child[i]);
+	for (i = 0; i < count; ++i)
+		attrs[i].length = sysfs_read_raw(dirfd, attrs[i].name,
+						 attrs[i].buffer, attrs[i].size);
+}
 
-	for (i = 0; i < MAX_CONFIGS; ++i)
-		DestroyConfig (device->config[i]);
+static int sysfs_open_dir(int dirfd, const char *name)
+{
+	SCAN_COUNT(USB_SCAN_OPENS);
+	return openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
 
-	if (device->bandwidth != NULL) {
-		DestroyBandwidth (device->bandwidth);
-		g_free (device->bandwidth);
-	}
+/* readdir() a directory we already hold open, without closing our fd */
+static DIR *sysfs_list_dir(int dirfd)
+{
+	DIR *d;
+	int fd;
 
-	g_free (device->name);
-	g_free (device->version);
-	g_free (device->class);
-	g_free (device->subClass);
-	g_free (device->protocol);
-	g_free (device->revisionNumber);
-	g_free (device->manufacturer);
-	g_free (device->product);
-	g_free (device->serialNumber);
+	fd = dup(dirfd);
+	if (fd < 0)
+		return NULL;
 
-	g_free (device);
+	d = fdopendir(fd);
+	if (!d) {
+		close(fd);
+		return NULL;
+	}
 
-	return;
+	/* the dup() shares the file position, so start over at the top */
+	rewinddir(d);
+	return d;
 }
 
-static struct Device *FindDeviceNode(struct Device *device,
-				     int deviceNumber, int busNumber)
+static struct dirent *sysfs_readdir(DIR *d)
 {
-	int     i;
-	struct Device *result;
-
-	if (device == NULL)
-		return(NULL);
+	SCAN_COUNT(USB_SCAN_DIR_READS);
+	return readdir(d);
+}
 
-	if ((device->deviceNumber == deviceNumber) &&
-	    (device->busNumber == busNumber))
-		return(device);
+static struct DeviceEndpoint *CopyEndpoint (struct arena *arena,
+					    const struct DeviceEndpoint *endpoint)
+{
+	struct DeviceEndpoint *copy;
 
-	for (i = 0; i < MAX_CHILDREN; ++i) {
-		result = FindDeviceNode (device->child[i], deviceNumber, busNumber);
-		if (result != NULL)
-			return(result);
-	}
+	copy = arena_memdup (arena, endpoint, sizeof(*endpoint));
 
-	return(NULL);
+	return copy;
 }
 
-struct Device *usb_find_device (int deviceNumber, int busNumber)
+
+static struct DeviceInterface *CopyInterface (struct arena *arena,
+					      const struct DeviceInterface *interface)
 {
+	struct DeviceInterface *copy;
 	int     i;
-	struct Device *result;
 
-	/* search through the tree to try to find a device */
-	for (i = 0; i < MAX_CHILDREN; ++i) {
-		result = FindDeviceNode (rootDevice->child[i], deviceNumber, busNumber);
-		if (result != NULL)
-			return(result);
-	}
-	return(NULL);
+	copy = arena_memdup (arena, interface, sizeof(*interface));
+	copy->endpoint = arena_alloc0 (arena, interface->endpointCount * sizeof(struct DeviceEndpoint *));
+	for (i = 0; i < interface->endpointCount; ++i)
+		copy->endpoint[i] = CopyEndpoint (arena, interface->endpoint[i]);
+
+	return copy;
 }
 
-/* Build all of the names of the devices */
-static void NameDevice (struct Device *device)
+
+static struct DeviceConfig *CopyConfig (struct arena *arena,
+					const struct DeviceConfig *config)
 {
-	int     configNum;
-	int     interfaceNum;
+	struct DeviceConfig *copy;
 	int     i;
 
-	if (device == NULL)
-		return;
+	copy = arena_memdup (arena, config, sizeof(*config));
+	copy->interface = arena_alloc0 (arena, config->interfaceCount * sizeof(struct DeviceInterface *));
+	for (i = 0; i < config->interfaceCount; ++i)
+		copy->interface[i] = CopyInterface (arena, config->interface[i]);
 
-	/* build the name for this device */
-	if (device != rootDevice) {
-		if (device->name)
-			g_free (device->name);
-		device->name = (gchar *)g_malloc0 (DEVICE_STRING_MAXSIZE*sizeof (gchar));
+	return copy;
+}
 
-		/* see if this device has a product name */
-		if (device->product != NULL) {
-			strcpy (device->name, device->product);
-			goto create_children_names;
-		}
 
-		/* see if this device is a root hub */
-		if (device->level == 0) {
-			strcpy (device->name, "root hub");
-			goto create_children_names;
-		}
+/* Make a copy of a device, and everything plugged into it, in another arena */
+static struct Device *CopyDevice (struct arena *arena, const struct Device *device,
+				  struct Device *parent, guint generation)
+{
+	struct Device *copy;
+	int     i;
 
-		/* look through all of the interfaces of this device, adding them all up to form a name */
-		for (configNum = 0; configNum < MAX_CONFIGS; ++configNum) {
-			if (device->config[configNum]) {
-				struct DeviceConfig *config = device->config[configNum];
-				for (interfaceNum = 0; interfaceNum < MAX_INTERFACES; ++interfaceNum) {
-					if (config->interface[interfaceNum]) {
-						struct DeviceInterface *interface = config->interface[interfaceNum];
-						if (interface->name != NULL) {
-							if (strstr (interface->name, "none") == NULL) {
-								if (strcmp (interface->name, "hid") == 0) {
-									if (interface->subClass == 1) {
-										switch (interface->protocol) {
-											case 1 :
-												strcat (device->name, "keyboard");
-												continue;
-											case 2 :
-												strcat (device->name, "mouse");
-												continue;
-										}
-									}
-								}
-								if (strstr (device->name, interface->name) == NULL) {
-									if (strlen (device->name) > 0) {
-										strcat (device->name, " / ");
-									}
-									strcat (device->name, interface->name);
-								}
-							}
-						}
-					}
-				}
-			}
-		}
+	copy = arena_memdup (arena, device, sizeof(*device));
+	copy->parent = parent;
+	copy->generation = generation;
 
-		if (strlen (device->name) == 0) {
-			strcat (device->name, "Unknown Device");
-		}
+	/* keep room for all of the ports, for devices that show up later */
+	copy->child = arena_alloc0 (arena, MAX(device->maxChildren, device->childCount) *
+				    sizeof(struct Device *));
+	for (i = 0; i < device->childCount; ++i)
+		copy->child[i] = CopyDevice (arena, device->child[i], copy, generation);
 
-	}
+	copy->config = arena_alloc0 (arena, device->configCount * sizeof(struct DeviceConfig *));
+	for (i = 0; i < device->configCount; ++i)
+		copy->config[i] = CopyConfig (arena, device->config[i]);
 
-	create_children_names:
+	copy->bandwidth = arena_memdup (arena, device->bandwidth, sizeof(*device->bandwidth));
 
-	/* create all of the children's names */
-	for (i = 0; i < MAX_CHILDREN; ++i) {
-		NameDevice (device->child[i]);
-	}
+	copy->sysfsName = arena_strdup (arena, device->sysfsName);
+	copy->manufacturer = arena_strdup (arena, device->manufacturer);
+	copy->product = arena_strdup (arena, device->product);
 
-	return;
-}
+	/* the other names are all static or interned */
+	if (device->name == device->product)
+		copy->name = copy->product;
+	copy->serialNumber = arena_strdup (arena, device->serialNumber);
 
+	return copy;
+}
 
-void usb_initialize_list (void)
+/*
+ * Make a copy of just the device, in another arena.  The devices plugged
+ * into it, and everything it points to, are shared with the original.
+ */
+static struct Device *ShareDevice (struct arena *arena, const struct Device *device,
+				   struct Device *parent, guint generation)
 {
-	if (rootDevice != NULL) {
-		DestroyDevice (rootDevice);
-		rootDevice = NULL;
-	}
+	struct Device *copy;
 
-	rootDevice = (struct Device *)g_malloc0 (sizeof(struct Device));
+	copy = arena_memdup (arena, device, sizeof(*device));
+	copy->parent = parent;
+	copy->generation = generation;
 
-	/* clean up any bandwidth devices */
-	if (currentBandwidth != NULL) {
-		DestroyBandwidth (currentBandwidth);
-		g_free (currentBandwidth);
-	}
+	/* keep room for all of the ports, for devices that show up later */
+	copy->child = arena_alloc0 (arena, MAX(device->maxChildren, device->childCount) *
+				    sizeof(struct Device *));
+	if (device->childCount)
+		memcpy (copy->child, device->child, device->childCount * sizeof(struct Device *));
 
-	return;
+	return copy;
 }
 
-struct entity {
-	struct list_node list;
-	char *name;
-};
-
-static struct entity *entity_create(char *name)
+/*
+ * The lookups below all go through the indexes built when the snapshot was
+ * made, so none of them has to walk the tree.
+ */
+struct Device *usb_find_device (struct UsbSnapshot *snapshot, guint64 handle)
 {
-	struct entity *e;
+	if (snapshot == NULL)
+		return(NULL);
 
-	e = malloc(sizeof(*e));
-	memset(e, 0x00, sizeof(*e));
-	e->name = g_strdup(name);
-	return e;
+	return g_hash_table_lookup (snapshot->byHandle, &handle);
 }
 
-static void entity_destroy(struct entity *e)
+struct Device *usb_find_device_by_name (struct UsbSnapshot *snapshot,
+					const char *sysfsName)
 {
-	list_del(&e->list);
-	g_free(e->name);
-	g_free(e);
+	if (snapshot == NULL)
+		return(NULL);
+
+	return g_hash_table_lookup (snapshot->byName, sysfsName);
 }
 
-static void entity_add(struct list_head *list, struct entity *e)
+/* all the devices with this vendor and product id, or NULL if there are none */
+const GPtrArray *usb_find_devices_by_id (struct UsbSnapshot *snapshot,
+					 gint vendorId, gint productId)
 {
-	struct entity *iter;
-
-	list_for_each(list, iter, list) {
-		if (strcmp(iter->name, e->name) > 0) {
-			list_add_before(list, &iter->list, &e->list);
-			goto exit;
-		}
-	}
-	list_add_tail(list, &e->list);
+	if (snapshot == NULL)
+		return(NULL);
 
-exit:
-#ifdef DEBUG_LIST
-	printf("list = ");
-	list_for_each(list, iter, list) {
-		printf("%s ", iter->name);
-	}
-	printf("\n");
-#endif
-	return;
+	return g_hash_table_lookup (snapshot->byId,
+				    GUINT_TO_POINTER ((((guint)vendorId & 0xffff) << 16) |
+						      ((guint)productId & 0xffff)));
 }
 
-static void endpoint_parse(struct DeviceInterface *interface, const char *dir)
+/* serial numbers should be unique, but plenty of cheap devices share one */
+const GPtrArray *usb_find_devices_by_serial (struct UsbSnapshot *snapshot,
+					     const char *serialNumber)
 {
-	struct DeviceEndpoint *endpoint;
-	int             i;
-
-	/* find a place in this interface to place the endpoint */
-	for (i = 0; i < MAX_ENDPOINTS; ++i) {
-		if (interface->endpoint[i] == NULL) {
-			break;
-		}
-	}
-	if (i >= MAX_ENDPOINTS) {
-		/* ran out of room to hold this endpoint */
-		g_warning ("Too many endpoints for this device.\n");
-		return;
-	}
+	if ((snapshot == NULL) || (serialNumber == NULL))
+		return(NULL);
 
-	endpoint = g_malloc0(sizeof(struct DeviceEndpoint));
+	return g_hash_table_lookup (snapshot->bySerial, serialNumber);
+}
 
-	endpoint->attribute	= sysfs_int(dir, "bmAttributes", 16);
-	endpoint->maxPacketSize	= sysfs_int(dir, "wMaxPacketSize", 16);
+/* most driver names a device name is made of, any more are left off */
+#define NAME_PARTS	8
 
-	char *epdir	= sysfs_string(dir, "direction");
-	if (!strcmp(epdir, "in"))
-		endpoint->in = TRUE;
-	else
-		endpoint->in = FALSE;
-	g_free(epdir);
+/*
+ * What the name of a device without a product string is made of: the
+ * drivers of its active interfaces, each one only once.  They are all
+ * interned, so they can be compared by pointer.
+ */
+struct name_key {
+	guint		count;
+	const gchar	*parts[NAME_PARTS];
+};
 
-	endpoint->type		= sysfs_string(dir, "type");
-	endpoint->interval	= sysfs_string(dir, "interval");
-	endpoint->address	= sysfs_int(dir, "bEndpointAddress", 16);
+/* names built so far, a device with the same drivers gets the same name */
+static GHashTable *nameCache;
+static GMutex nameCacheLock;
 
-	/* point the interface to the endpoint */
-	interface->endpoint[i] = endpoint;
+static guint name_key_hash (gconstpointer data)
+{
+	const struct name_key *key = data;
+	guint hash = key->count;
+	guint i;
 
-	// FIXME check max packet size
-#if 0
-	char *maxps_hex = sysfs_read(dir, "wMaxPacketSize");
-	int maxps_num = strtol(maxps_hex, NULL, 16);
+	for (i = 0; i < key->count; ++i)
+		hash = (hash * 31) + g_direct_hash (key->parts[i]);
+	return hash;
+}
 
-	/* max packet size is bits 0-10 with multiplicity values in bits 11 and 12 */
-	maxps_num = (maxps_num & 0x7ff) * (1 + ((maxps_num >> 11) & 0x03));
+static gboolean name_key_equal (gconstpointer a, gconstpointer b)
+{
+	const struct name_key *first = a;
+	const struct name_key *second = b;
 
-	printf("E:  Ad=%s(%s) Atr=%s(%s) MxPS=%4d Ivl=%s\n",
-	       addr, direction, attr, type, maxps_num, interval);
-#endif
+	return (first->count == second->count) &&
+	       (memcmp (first->parts, second->parts,
+			first->count * sizeof(first->parts[0])) == 0);
 }
 
-static void endpoints_parse(struct DeviceInterface *interface, const char *dir)
+static void name_key_add (struct name_key *key, const gchar *part)
 {
-	DIR *d;
-	struct dirent *de;
-	LIST_HEAD(endpoint_list);
-	struct entity *temp;
-	struct entity *e;
+	guint i;
 
-	d = opendir(dir);
-	if (!d) {
-		fprintf(stderr, "Can not open %s directory\n", dir);
-		return;
+	for (i = 0; i < key->count; ++i) {
+		if (key->parts[i] == part)
+			return;
 	}
+	if (key->count < NAME_PARTS)
+		key->parts[key->count++] = part;
+}
+
+/* look through all of the interfaces in use, to see what the name is made of */
+static void name_key_init (struct name_key *key, const struct Device *device)
+{
+	const gchar *noDriver = g_intern_static_string (INTERFACE_DRIVERNAME_NODRIVER_STRING);
+	const gchar *hid = g_intern_static_string ("hid");
+	const gchar *part;
+	int     configNum;
+	int     interfaceNum;
 
-	while ((de = readdir(d))) {
-		if (de->d_type == DT_DIR) {
-			/* See if this directory is an interface or not */
-			char endpoint[PATH_MAX];
+	key->count = 0;
+	for (configNum = 0; configNum < device->configCount; ++configNum) {
+		struct DeviceConfig *config = device->config[configNum];
 
-			snprintf(endpoint, PATH_MAX, "%s/%s", dir, de->d_name);
-			char *endpointaddr = sysfs_string(endpoint, "bEndpointAddress");
-			if (endpointaddr) {
-				e = entity_create(endpoint);
-				entity_add(&endpoint_list, e);
-				g_free(endpointaddr);
-			}
+		if (!config->active)
+			continue;
+		for (interfaceNum = 0; interfaceNum < config->interfaceCount; ++interfaceNum) {
+			struct DeviceInterface *interface = config->interface[interfaceNum];
 
+			part = interface->name;
+			if (!interface->active || (part == NULL) || (part == noDriver))
+				continue;
+
+			if ((part == hid) && (interface->subClass == 1)) {
+				if (interface->protocol == 1)
+					part = g_intern_static_string ("keyboard");
+				else if (interface->protocol == 2)
+					part = g_intern_static_string ("mouse");
+			}
+			name_key_add (key, part);
 		}
 	}
+}
 
-	closedir(d);
+/* add "part" to the end of a name, cutting it short when the name is full */
+static gsize name_append (gchar *name, gsize length, const gchar *part)
+{
+	gsize size = strlen (part);
 
-	list_for_each_safe(&endpoint_list, e, temp, list) {
-		endpoint_parse(interface, e->name);
-		entity_destroy(e);
-	}
+	if (size > DEVICE_STRING_MAXSIZE - 1 - length)
+		size = DEVICE_STRING_MAXSIZE - 1 - length;
+	memcpy (&name[length], part, size);
+	return length + size;
 }
 
-static void interface_parse(struct Device *device, const char *dir)
+static const gchar *name_build (const struct name_key *key)
 {
-	struct DeviceConfig *config;
-	struct DeviceInterface *interface;
-	int             i;
-	int             configNum;
-
-	/* find the LAST config in the device */
-	configNum = -1;
-	for (i = 0; i < MAX_CONFIGS; ++i)
-		if (device->config[i])
-			configNum = i;
-	if (configNum == -1) {
-		/* no config to put this interface at, not good */
-		g_warning ("No config to put an interface at for this device.\n");
-		return;
-	}
+	gchar   name[DEVICE_STRING_MAXSIZE];
+	gsize   length = 0;
+	guint   i;
 
-	config = device->config[configNum];
+	if (key->count == 0)
+		return "Unknown Device";
 
-	/* now find a place in this config to place the interface */
-	for (i = 0; i < MAX_INTERFACES; ++i)
-		if (config->interface[i] == NULL)
-			break;
-	if (i >= MAX_INTERFACES) {
-		/* ran out of room to hold this interface */
-		g_warning ("Too many interfaces for this device.\n");
-		return;
+	for (i = 0; i < key->count; ++i) {
+		if (i > 0)
+			length = name_append (name, length, " / ");
+		length = name_append (name, length, key->parts[i]);
 	}
+	name[length] = 0x00;
 
-	interface = g_malloc0(sizeof(struct DeviceInterface));
+	return g_intern_string (name);
+}
 
-	interface->interfaceNumber	= sysfs_int(dir, "bInterfaceNumber", 10);
-	interface->alternateNumber	= sysfs_int(dir, "bAlternateSetting", 10);
-	interface->numEndpoints		= sysfs_int(dir, "bNumEndpoints", 10);
-	interface->subClass		= sysfs_int(dir, "bInterfaceSubClass", 16);
-	interface->protocol		= sysfs_int(dir, "bInterfaceProtocol", 16);
+/* Build all of the names of the devices */
+static void NameDevice (struct Device *device)
+{
+	struct name_key key;
+	const gchar *name;
+	int     i;
 
-	interface->class		= sysfs_string(dir, "bInterfaceClass");
+	if (device == NULL)
+		return;
 
-	char drivername[PATH_MAX];
-	char link[PATH_MAX];
-	struct stat sb;
-	int retval;
-	char *driver = "(none)";
+	/* build the name for this device, the root of the tree has none */
+	if (device->parent != NULL) {
+		if (device->product != NULL) {
+			/* see if this device has a product name */
+			device->name = device->product;
+		} else if (device->level == 0) {
+			/* see if this device is a root hub */
+			device->name = "root hub";
+		} else {
+			name_key_init (&key, device);
+
+			g_mutex_lock (&nameCacheLock);
+			if (nameCache == NULL)
+				nameCache = g_hash_table_new (name_key_hash, name_key_equal);
+			name = g_hash_table_lookup (nameCache, &key);
+			if (name == NULL) {
+				struct name_key *copy = g_new (struct name_key, 1);
+
+				*copy = key;
+				name = name_build (&key);
+				g_hash_table_insert (nameCache, copy, (gpointer)name);
+			}
+			g_mutex_unlock (&nameCacheLock);
 
-	/*
-	 * find the driver name by looking at the basename of the driver
-	 * symbolic link.
-	 * In bash this would just be:
-	 *	driver=`readlink $ifpath/driver`
-	 *	driver=`basename "$driver"`
-	 */
-	snprintf(drivername, PATH_MAX, "%s/driver", dir);
-	retval = stat(drivername, &sb);
-	memset(link, 0x00, sizeof(link));
-	if (!retval) {
-		retval = readlink(drivername, link, sizeof(link));
-		if (retval > 0) {
-			/*
-			 * crude 'basename', go to the end of the string and
-			 * walk back to find a '/' and then go forward one.
-			 */
-			driver = &link[strlen(link)];
-			while (driver[0] != '/')
-				driver--;
-			driver++;
+			device->name = name;
 		}
 	}
 
-	interface->name = g_strdup(driver);
-
-	/* if this interface does not have a driver attached to it, save that info for later */
-	if (strncmp(interface->name, INTERFACE_DRIVERNAME_NODRIVER_STRING,
-		    INTERFACE_DRIVERNAME_STRING_MAXLENGTH) == 0) {
-		interface->driverAttached = FALSE;
-	} else {
-		interface->driverAttached = TRUE;
+	/* create all of the children's names */
+	for (i = 0; i < device->childCount; ++i) {
+		NameDevice (device->child[i]);
 	}
 
-	/* now point the config to this interface */
-	config->interface[i] = interface;
-
-	endpoints_parse(interface, dir);
+	return;
 }
 
-static void interfaces_parse(struct Device *device, const char *dir)
-{
-	DIR *d;
-	struct dirent *de;
-	LIST_HEAD(interface_list);
-	struct entity *temp;
-	struct entity *e;
 
-	d = opendir(dir);
-	if (!d) {
-		fprintf(stderr, "Can not open %s directory\n", dir);
-		return;
-	}
+static void DestroySnapshot (struct UsbSnapshot *snapshot)
+{
+	g_hash_table_destroy (snapshot->byHandle);
+	g_hash_table_destroy (snapshot->byName);
+	g_hash_table_destroy (snapshot->byId);
+	g_hash_table_destroy (snapshot->bySerial);
 
-	while ((de = readdir(d))) {
-		if (de->d_type == DT_DIR) {
-			/* See if this directory is an interface or not */
-			char interface[PATH_MAX];
+	/* the whole tree lives in the arena, so it all goes in one go */
+	arena_free (snapshot->arena);
 
-			snprintf(interface, PATH_MAX, "%s/%s", dir, de->d_name);
-			char *interfacenum = sysfs_string(interface, "bInterfaceNumber");
-			if (interfacenum) {
-				e = entity_create(interface);
-				entity_add(&interface_list, e);
-				g_free(interfacenum);
-			}
-		}
-	}
+	/* and a loaded one points into its file as well */
+	if (snapshot->file != NULL)
+		g_mapped_file_unref (snapshot->file);
 
-	closedir(d);
+	/* the devices it did not copy are not needed any more either */
+	usb_snapshot_unref (snapshot->base);
 
-	list_for_each_safe(&interface_list, e, temp, list) {
-		interface_parse(device, e->name);
-		entity_destroy(e);
-	}
+	g_free (snapshot);
 }
 
-static void device_parse(struct Device *parent, const char *directory);
-
-static void children_parse(struct Device *parent, const char *dir)
+struct UsbSnapshot *usb_snapshot_ref (struct UsbSnapshot *snapshot)
 {
-	int devcount = 0;
-	DIR *d;
-	struct dirent *de;
+	g_atomic_int_inc (&snapshot->refCount);
+	return snapshot;
+}
 
-	d = opendir(dir);
-	if (!d) {
-		fprintf(stderr, "Can not open %s directory\n", dir);
+void usb_snapshot_unref (struct UsbSnapshot *snapshot)
+{
+	if (snapshot == NULL)
 		return;
-	}
 
-	while ((de = readdir(d))) {
-		if (de->d_type == DT_DIR) {
-			if (de->d_name[0] == '.')
-				continue;
+	if (g_atomic_int_dec_and_test (&snapshot->refCount))
+		DestroySnapshot (snapshot);
+}
+
+/*
+ * Hash a device handle.  g_int64_hash() folds the two halves together,
+ * which for a handle is just the bus number xor the address, so with many
+ * buses most devices end up on a few hash values.  Spread the bus out
+ * instead.
+ */
+guint usb_handle_hash (gconstpointer key)
+{
+	guint64 handle = *(const guint64 *)key;
 
-			/* See if this directory is an interface or not */
-			char device[PATH_MAX];
+	return (guint)(handle >> 32) * 0x9e3779b1u + (guint)handle;
+}
 
-			snprintf(device, PATH_MAX, "%s/%s", dir, de->d_name);
-			char *device_class = sysfs_string(device, "bDeviceClass");
-			if (device_class) {
-				++devcount;
-				device_parse(parent, device);
-			}
+struct UsbSnapshot *usb_snapshot_new (void)
+{
+	static gint generation;
+	struct UsbSnapshot *snapshot;
+
+	snapshot = g_malloc0 (sizeof(struct UsbSnapshot));
+	snapshot->refCount = 1;
+	snapshot->generation = g_atomic_int_add (&generation, 1) + 1;
+	snapshot->arena = arena_new ();
+
+	/* the keys all point into the tree, so only the lists are ours to free */
+	snapshot->byHandle = g_hash_table_new (usb_handle_hash, g_int64_equal);
+	snapshot->byName = g_hash_table_new (g_str_hash, g_str_equal);
+	snapshot->byId = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						NULL, (GDestroyNotify)g_ptr_array_unref);
+	snapshot->bySerial = g_hash_table_new_full (g_str_hash, g_str_equal,
+						    NULL, (GDestroyNotify)g_ptr_array_unref);
+
+	return snapshot;
+}
 
-			g_free(device_class);
-		}
+static void IndexAppend (GHashTable *table, gpointer key, struct Device *device)
+{
+	GPtrArray *devices;
+
+	devices = g_hash_table_lookup (table, key);
+	if (devices == NULL) {
+		devices = g_ptr_array_sized_new (1);
+		g_hash_table_insert (table, key, devices);
 	}
+	g_ptr_array_add (devices, device);
+}
 
-	closedir(d);
+/*
+ * FNV-1a, but the numbers are mixed in whole instead of a byte at a time.
+ * It only has to tell trees apart, nobody is trying to fool it.
+ */
+#define HASH_INIT	G_GUINT64_CONSTANT (0xcbf29ce484222325)
+#define HASH_PRIME	G_GUINT64_CONSTANT (0x100000001b3)
+
+static guint64 hash_int (guint64 hash, gint value)
+{
+	return (hash ^ (guint32)value) * HASH_PRIME;
 }
 
-static void device_parse(struct Device *parent, const char *dir)
+static guint64 hash_string (guint64 hash, const gchar *string)
 {
-	struct Device *device;
+	/* NULL has to hash differently from "" */
+	if (string == NULL)
+		return hash_int (hash, -1);
 
-	if (check_dir_present(dir))
-		return;
+	do {
+		hash = (hash ^ (guchar)*string) * HASH_PRIME;
+	} while (*string++);
 
-	device = (struct Device *)(g_malloc0 (sizeof(struct Device)));
+	return hash;
+}
 
-	if (parent == rootDevice)
-		device->level = 0;
+/*
+ * Everything about a device but its children.  Its bandwidth is worked out
+ * before the snapshot is indexed, so a hub whose use, or highlight, changed
+ * does not look the same as before.
+ */
+static guint64 hash_device (const struct Device *device)
+{
+	guint64 hash = HASH_INIT;
+	int     i, j, k;
+
+	hash = hash_string (hash, device->name);
+	hash = hash_string (hash, device->sysfsName);
+	hash = hash_int (hash, device->busNumber);
+	hash = hash_int (hash, device->level);
+	hash = hash_int (hash, device->portNumber);
+	hash = hash_int (hash, device->connectorNumber);
+	hash = hash_int (hash, device->deviceNumber);
+	hash = hash_int (hash, device->speed);
+	hash = hash_int (hash, device->maxChildren);
+	hash = hash_string (hash, device->version);
+	hash = hash_string (hash, device->class);
+	hash = hash_string (hash, device->subClass);
+	hash = hash_string (hash, device->protocol);
+	hash = hash_int (hash, device->maxPacketSize);
+	hash = hash_int (hash, device->numConfigs);
+	hash = hash_int (hash, device->vendorId);
+	hash = hash_int (hash, device->productId);
+	hash = hash_string (hash, device->revisionNumber);
+	hash = hash_string (hash, device->manufacturer);
+	hash = hash_string (hash, device->product);
+	hash = hash_string (hash, device->serialNumber);
+
+	hash = hash_int (hash, device->bandwidth != NULL);
+	if (device->bandwidth != NULL) {
+		hash = hash_int (hash, device->bandwidth->percent);
+		hash = hash_int (hash, usb_bandwidth_over (device->bandwidth));
+	}
+
+	hash = hash_int (hash, device->configCount);
+	for (i = 0; i < device->configCount; ++i) {
+		const struct DeviceConfig *config = device->config[i];
+
+		hash = hash_int (hash, config->configNumber);
+		hash = hash_int (hash, config->numInterfaces);
+		hash = hash_int (hash, config->attributes);
+		hash = hash_string (hash, config->maxPower);
+		hash = hash_int (hash, config->active);
+
+		hash = hash_int (hash, config->interfaceCount);
+		for (j = 0; j < config->interfaceCount; ++j) {
+			const struct DeviceInterface *interface = config->interface[j];
+
+			hash = hash_string (hash, interface->name);
+			hash = hash_int (hash, interface->interfaceNumber);
+			hash = hash_int (hash, interface->alternateNumber);
+			hash = hash_int (hash, interface->numEndpoints);
+			hash = hash_int (hash, interface->subClass);
+			hash = hash_int (hash, interface->protocol);
+			hash = hash_string (hash, interface->class);
+			hash = hash_int (hash, interface->driverAttached);
+			hash = hash_int (hash, interface->active);
+
+			hash = hash_int (hash, interface->endpointCount);
+			for (k = 0; k < interface->endpointCount; ++k) {
+				const struct DeviceEndpoint *endpoint = interface->endpoint[k];
+
+				hash = hash_int (hash, endpoint->address);
+				hash = hash_int (hash, endpoint->in);
+				hash = hash_int (hash, endpoint->attribute);
+				hash = hash_string (hash, endpoint->type);
+				hash = hash_int (hash, endpoint->maxPacketSize);
+				hash = hash_string (hash, endpoint->interval);
+			}
+		}
+	}
+
+	return hash;
+}
+
+/* the device's own hash, then the subtree hashes of all of its children */
+static void hash_subtree (struct Device *device)
+{
+	guint64 hash;
+	int     i;
+
+	hash = device->hash;
+	for (i = 0; i < device->childCount; ++i)
+		hash = (hash ^ device->child[i]->subtreeHash) * HASH_PRIME;
+	device->subtreeHash = hash;
+}
+
+/*
+ * Add a device, and everything plugged into it, to the snapshot's indexes,
+ * and work out their hashes on the way back up.
+ */
+static void IndexDevice (struct UsbSnapshot *snapshot, struct Device *device)
+{
+	struct DeviceConfig *config;
+	int     i;
+	int     j;
+
+	g_hash_table_insert (snapshot->byHandle, &device->handle, device);
+	if (device->sysfsName)
+		g_hash_table_insert (snapshot->byName, device->sysfsName, device);
+	IndexAppend (snapshot->byId,
+		     GUINT_TO_POINTER ((((guint)device->vendorId & 0xffff) << 16) |
+				       ((guint)device->productId & 0xffff)),
+		     device);
+	if (device->serialNumber && device->serialNumber[0])
+		IndexAppend (snapshot->bySerial, device->serialNumber, device);
+
+	++snapshot->stats.devices;
+	for (i = 0; i < device->configCount; ++i) {
+		config = device->config[i];
+		snapshot->stats.interfaces += config->interfaceCount;
+		for (j = 0; j < config->interfaceCount; ++j)
+			snapshot->stats.endpoints += config->interface[j]->endpointCount;
+	}
+
+	for (i = 0; i < device->childCount; ++i)
+		IndexDevice (snapshot, device->child[i]);
+
+	/* the ones shared with an older snapshot were hashed by it already */
+	if (device->generation == snapshot->generation) {
+		device->hash = hash_device (device);
+		hash_subtree (device);
+	}
+}
+
+/*
+ * Index a snapshot once its tree is complete.  Nothing may be added to it
+ * or taken away afterwards.
+ */
+void usb_snapshot_index (struct UsbSnapshot *snapshot)
+{
+	int     i;
+
+	for (i = 0; i < snapshot->root->childCount; ++i)
+		IndexDevice (snapshot, snapshot->root->child[i]);
+
+	snapshot->root->hash = HASH_INIT;
+	hash_subtree (snapshot->root);
+
+	snapshot->stats.bytes = arena_size (snapshot->arena);
+}
+
+/* everything one scan needs to carry around */
+struct scan {
+	struct Device	*root;
+	struct arena	*arena;		/* the new snapshot's */
+	guint		generation;	/* the new snapshot's */
+	GCancellable	*cancellable;
+	GThreadPool	*pool;		/* NULL for a scan on just this thread */
+	GMutex		lock;
+	GCond		idle;
+	guint		pending;	/* jobs queued up on the pool, or running */
+	struct UsbScanStats *stats;	/* the new snapshot's */
+};
+
+/* A run of devices from the listing to read on the thread pool */
+struct scan_job {
+	struct scan	*scan;
+	int		dirfd;		/* the /sys/bus/usb/devices directory */
+	GPtrArray	*names;
+	struct Device	**devices;	/* where the devices read go, by index */
+	guint		first;
+	guint		count;
+};
+
+/* how many devices one job on the pool reads */
+#define SCAN_JOB_DEVICES	8
+
+/* number of threads scans may use, 0 picks one per processor */
+static int scanThreads;
+
+/* where the devices are read from, if not USB_DEVICES_DIR */
+static gchar *devicesDir;
+
+/* how much of its periodic bandwidth a bus may have reserved before it is flagged */
+static int bandwidthThreshold = 80;
+
+struct scan_request {
+	struct UsbSnapshot *old;
+	GPtrArray	*names;
+};
+
+/* descriptor types and sizes, from chapter 9 of the USB spec */
+#define USB_DT_DEVICE			0x01
+#define USB_DT_CONFIG			0x02
+#define USB_DT_INTERFACE		0x04
+#define USB_DT_ENDPOINT			0x05
+#define USB_DT_DEVICE_SIZE		18
+#define USB_DT_CONFIG_SIZE		9
+#define USB_DT_INTERFACE_SIZE		9
+#define USB_DT_ENDPOINT_SIZE		7
+
+#define USB_ENDPOINT_XFERTYPE_MASK	0x03
+#define USB_ENDPOINT_XFER_CONTROL	0
+#define USB_ENDPOINT_XFER_ISOC		1
+#define USB_ENDPOINT_XFER_BULK		2
+#define USB_ENDPOINT_XFER_INT		3
+#define USB_ENDPOINT_DIR_MASK		0x80
+
+static inline int le16(const unsigned char *data)
+{
+	return data[0] | (data[1] << 8);
+}
+
+/*
+ * Read a whole binary sysfs file, like "descriptors".  The buffer is
+ * allocated and must be freed by the caller.
+ */
+static unsigned char *sysfs_binary(int dirfd, const char *filename, ssize_t *length)
+{
+	unsigned char *buffer;
+	size_t size = 4096;
+	ssize_t count;
+	ssize_t total = 0;
+	int fd;
+
+	SCAN_COUNT(USB_SCAN_OPENS);
+	fd = openat(dirfd, filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	buffer = g_malloc(size);
+	while (1) {
+		count = read_all(fd, (char *)&buffer[total], size - total);
+		if (count <= 0)
+			break;
+		total += count;
+		if ((size_t)total < size)
+			break;
+		size *= 2;
+		buffer = g_realloc(buffer, size);
+	}
+	close(fd);
+
+	if (total == 0) {
+		g_free(buffer);
+		return NULL;
+	}
+
+	*length = total;
+	return buffer;
+}
+
+/*
+ * Most descriptor strings are the same few values all over the tree, so
+ * they are kept only once, in glib's (thread-safe) table of interned
+ * strings, and can be compared by pointer.
+ */
+static const gchar *intern_printf(const gchar *format, ...) G_GNUC_PRINTF(1, 2);
+static const gchar *intern_printf(const gchar *format, ...)
+{
+	gchar buffer[64];
+	va_list args;
+
+	va_start(args, format);
+	g_vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	return g_intern_string(buffer);
+}
+
+static const char *endpoint_type_string(int attributes)
+{
+	switch (attributes & USB_ENDPOINT_XFERTYPE_MASK) {
+	case USB_ENDPOINT_XFER_CONTROL:	return "Control";
+	case USB_ENDPOINT_XFER_ISOC:	return "Isoc";
+	case USB_ENDPOINT_XFER_BULK:	return "Bulk";
+	default:			return "Interrupt";
+	}
+}
+
+/*
+ * How long one transaction takes on the bus, in ns, with the estimates of
+ * section 5.11.3 of the USB 2.0 spec that the kernel uses as well.  Data
+ * is bit stuffed, which adds up to one bit in every six.
+ */
+#define BIT_TIME(bytes)		(7L * 8L * (bytes) / 6L)
+#define BW_HOST_DELAY		1000L	/* full and low speed */
+#define BW_HUB_LS_SETUP		333L
+#define USB2_HOST_DELAY		5L
+
+static long transaction_time(int speed, gboolean in, gboolean isoc, int bytes)
+{
+	switch (speed) {
+	case 1:		/* low speed, which only does interrupt */
+		if (in)
+			return 64060L + 2 * BW_HUB_LS_SETUP + BW_HOST_DELAY +
+			       (67667L * (31L + 10L * BIT_TIME(bytes))) / 1000L;
+		return 64107L + 2 * BW_HUB_LS_SETUP + BW_HOST_DELAY +
+		       (66700L * (31L + 10L * BIT_TIME(bytes))) / 1000L;
+	case 12:
+		if (isoc)
+			return (in ? 7268L : 6265L) + BW_HOST_DELAY +
+			       (8354L * (31L + 10L * BIT_TIME(bytes))) / 1000L;
+		return 9107L + BW_HOST_DELAY + (8354L * (31L + 10L * BIT_TIME(bytes))) / 1000L;
+	case 480:
+		return ((isoc ? 38L : 55L) * 8L * 2083L +
+			2083L * (3L + BIT_TIME(bytes))) / 1000L + USB2_HOST_DELAY;
+	}
+
+	/* SuperSpeed is not budgeted per frame, so it is not counted */
+	return 0;
+}
+
+/*
+ * The ns of every 1ms frame a periodic endpoint reserves, on average.
+ * High speed ones run every so many microframes, and can move up to three
+ * packets in each, which bits 11 and 12 of wMaxPacketSize say.
+ */
+static int endpoint_bus_time(int attributes, int address, int wMaxPacketSize,
+			     int bInterval, int speed)
+{
+	gboolean in = (address & USB_ENDPOINT_DIR_MASK);
+	gboolean isoc;
+	int packets = 1;
+	long interval;
+	long time;
+
+	switch (attributes & USB_ENDPOINT_XFERTYPE_MASK) {
+	case USB_ENDPOINT_XFER_ISOC:
+		isoc = TRUE;
+		interval = 1 << (CLAMP(bInterval, 1, 16) - 1);
+		break;
+	case USB_ENDPOINT_XFER_INT:
+		isoc = FALSE;
+		if (speed == 480)
+			interval = 1 << (CLAMP(bInterval, 1, 16) - 1);
+		else
+			interval = MAX(bInterval, 1);
+		break;
+	default:
+		return 0;
+	}
+
+	if (speed == 480)
+		packets = 1 + ((wMaxPacketSize >> 11) & 0x03);
+
+	time = transaction_time(speed, in, isoc, wMaxPacketSize & 0x7ff) * packets;
+
+	/* high speed intervals are in microframes, eight to a frame */
+	if (speed == 480)
+		return time * 8 / interval;
+	return time / interval;
+}
+
+/* the same thing the kernel shows in the endpoint's "interval" file */
+static const char *endpoint_interval_string(int attributes, int address,
+					    int bInterval, int speed)
+{
+	unsigned int interval = 0;
+	gboolean in = (address & USB_ENDPOINT_DIR_MASK);
+	gboolean high = (speed == 480);
+
+	switch (attributes & USB_ENDPOINT_XFERTYPE_MASK) {
+	case USB_ENDPOINT_XFER_CONTROL:
+		if (high)
+			/* uframes per NAK */
+			interval = bInterval;
+		break;
+	case USB_ENDPOINT_XFER_ISOC:
+		interval = 1 << (CLAMP(bInterval, 1, 16) - 1);
+		break;
+	case USB_ENDPOINT_XFER_BULK:
+		if (high && !in)
+			/* uframes per NAK */
+			interval = bInterval;
+		break;
+	case USB_ENDPOINT_XFER_INT:
+		if (high)
+			interval = 1 << (CLAMP(bInterval, 1, 16) - 1);
+		else
+			interval = bInterval;
+		break;
+	}
+
+	interval *= high ? 125 : 1000;
+	if (interval % 1000)
+		return intern_printf("%dus", interval);
+	return intern_printf("%dms", interval / 1000);
+}
+
+/*
+ * Count the descriptors of one type, stopping at the first descriptor of
+ * type "stop", so the arrays holding them can be allocated right-sized.
+ */
+static int descriptor_count(const unsigned char *desc, int length, int type, int stop)
+{
+	int count = 0;
+	int offset;
+
+	for (offset = 0; offset + 2 <= length; offset += desc[offset]) {
+		if (desc[offset] < 2 || offset + desc[offset] > length)
+			break;
+		if (desc[offset + 1] == stop)
+			break;
+		if (desc[offset + 1] == type)
+			++count;
+	}
+
+	return count;
+}
+
+static void endpoint_parse(struct arena *arena, struct Device *device,
+			   struct DeviceInterface *interface, int room,
+			   const unsigned char *desc)
+{
+	struct DeviceEndpoint *endpoint;
+
+	/* only the ones counted when the interface was parsed fit */
+	if (interface->endpointCount >= room)
+		return;
+
+	endpoint = arena_alloc0(arena, sizeof(struct DeviceEndpoint));
+
+	endpoint->address	= desc[2];
+	endpoint->in		= (desc[2] & USB_ENDPOINT_DIR_MASK) ? TRUE : FALSE;
+	endpoint->attribute	= desc[3];
+	endpoint->maxPacketSize	= le16(&desc[4]);
+	endpoint->type		= endpoint_type_string(desc[3]);
+	endpoint->interval	= endpoint_interval_string(desc[3], desc[2],
+							   desc[6], device->speed);
+	endpoint->busTime	= endpoint_bus_time(desc[3], desc[2], le16(&desc[4]),
+						    desc[6], device->speed);
+
+	/* point the interface to the endpoint */
+	interface->endpoint[interface->endpointCount++] = endpoint;
+}
+
+/* the alternate setting in use, the driver is found by its link */
+const char * const usb_interface_attributes[] = {
+	"bAlternateSetting",
+	NULL
+};
+
+/*
+ * Fill in the sysfs-only parts of an interface of the active configuration:
+ * which alternate setting is in use, and which driver is bound to it.
+ */
+static void interface_sysfs_parse(struct Device *device, struct DeviceConfig *config,
+				  struct DeviceInterface *interface, int dirfd)
+{
+	char filename[PATH_MAX];
+	char link[PATH_MAX];
+	char ifname[64];
+	int retval;
+	const char *driver = INTERFACE_DRIVERNAME_NODRIVER_STRING;
+
+	/* "1-1.2:1.0", and root hubs are "1-0:1.0" */
+	if (device->level == 0)
+		snprintf(ifname, sizeof(ifname), "%d-0:%d.%d", device->busNumber,
+			 config->configNumber, interface->interfaceNumber);
 	else
+		snprintf(ifname, sizeof(ifname), "%s:%d.%d", device->sysfsName,
+			 config->configNumber, interface->interfaceNumber);
+
+	snprintf(filename, sizeof(filename), "%s/%s", ifname, usb_interface_attributes[0]);
+	interface->active = (sysfs_int(dirfd, filename, 10) == interface->alternateNumber);
+
+	/*
+	 * find the driver name by looking at the basename of the driver
+	 * symbolic link.  If there is no driver bound, there is no link, and
+	 * readlink() tells us so just as well as a stat() would.
+	 * In bash this would just be:
+	 *	driver=`readlink $ifpath/driver`
+	 *	driver=`basename "$driver"`
+	 */
+	snprintf(filename, sizeof(filename), "%s/driver", ifname);
+	SCAN_COUNT(USB_SCAN_READLINKS);
+	retval = readlinkat(dirfd, filename, link, sizeof(link) - 1);
+	if (retval > 0) {
+		link[retval] = 0x00;
+		driver = strrchr(link, '/');
+		driver = driver ? driver + 1 : link;
+	}
+
+	interface->name = g_intern_string(driver);
+
+	/* if this interface does not have a driver attached to it, save that info for later */
+	if (interface->name == g_intern_static_string(INTERFACE_DRIVERNAME_NODRIVER_STRING)) {
+		interface->driverAttached = FALSE;
+	} else {
+		interface->driverAttached = TRUE;
+	}
+}
+
+static struct DeviceInterface *interface_parse(struct arena *arena,
+					       struct DeviceConfig *config,
+					       const unsigned char *desc, int endpoints)
+{
+	struct DeviceInterface *interface;
+
+	interface = arena_alloc0(arena, sizeof(struct DeviceInterface));
+
+	interface->interfaceNumber	= desc[2];
+	interface->alternateNumber	= desc[3];
+	interface->numEndpoints		= desc[4];
+	interface->class		= intern_printf("%02x", desc[5]);
+	interface->subClass		= desc[6];
+	interface->protocol		= desc[7];
+
+	interface->endpoint = arena_alloc0(arena, sizeof(struct DeviceEndpoint *) * endpoints);
+
+	/* now point the config to this interface */
+	config->interface[config->interfaceCount++] = interface;
+
+	return interface;
+}
+
+/*
+ * Walk one configuration descriptor, and all of the interface and endpoint
+ * descriptors that follow it.  Returns the number of bytes used up.
+ */
+static int config_parse(struct arena *arena, struct Device *device,
+			const unsigned char *desc, int length)
+{
+	struct DeviceConfig *config;
+	struct DeviceInterface *interface = NULL;
+	int totalLength;
+	int endpoints = 0;
+	int offset;
+
+	if (length < USB_DT_CONFIG_SIZE || desc[1] != USB_DT_CONFIG)
+		return -1;
+
+	totalLength = MIN(le16(&desc[2]), length);
+
+	config = arena_alloc0(arena, sizeof(struct DeviceConfig));
+	config->numInterfaces	= desc[4];
+	config->configNumber	= desc[5];
+	config->attributes	= desc[7];
+	config->maxPower	= intern_printf("%dmA", desc[8] *
+						((device->speed >= 5000) ? 8 : 2));
+
+	config->interface	= arena_alloc0(arena, sizeof(struct DeviceInterface *) *
+					       descriptor_count(&desc[desc[0]], totalLength - desc[0],
+								USB_DT_INTERFACE, -1));
+
+	/* have the device now point to this config */
+	device->config[device->configCount++] = config;
+
+	for (offset = desc[0]; offset + 2 <= totalLength; offset += desc[offset]) {
+		if (desc[offset] < 2 || offset + desc[offset] > totalLength)
+			break;
+
+		switch (desc[offset + 1]) {
+		case USB_DT_INTERFACE:
+			/* the endpoints after a short one belong to no interface */
+			interface = NULL;
+			if (desc[offset] < USB_DT_INTERFACE_SIZE)
+				break;
+
+			/* make room for the endpoints that follow, up to the next interface */
+			endpoints = descriptor_count(&desc[offset + desc[offset]],
+						     totalLength - offset - desc[offset],
+						     USB_DT_ENDPOINT, USB_DT_INTERFACE);
+			interface = interface_parse(arena, config, &desc[offset], endpoints);
+			break;
+		case USB_DT_ENDPOINT:
+			if (desc[offset] < USB_DT_ENDPOINT_SIZE || interface == NULL)
+				break;
+			endpoint_parse(arena, device, interface, endpoints, &desc[offset]);
+			break;
+		}
+	}
+
+	return totalLength;
+}
+
+/*
+ * The "descriptors" file holds the raw device descriptor, followed by all
+ * of the configuration descriptors, so one read gets us everything the
+ * device told the kernel about itself, including the configurations and
+ * alternate settings that are not in use right now.
+ */
+static void descriptors_parse(struct arena *arena, struct Device *device, int dirfd,
+			      const unsigned char *desc, ssize_t length,
+			      int activeConfig)
+{
+	ssize_t offset;
+	int configNum;
+	int retval;
+	int i;
+
+	if (length < USB_DT_DEVICE_SIZE || desc[1] != USB_DT_DEVICE) {
+		g_warning ("Bad device descriptor for %s.\n", device->sysfsName);
+		return;
+	}
+
+	device->version		= intern_printf("%2x.%02x", desc[3], desc[2]);
+	device->class		= intern_printf("%02x", desc[4]);
+	device->subClass	= intern_printf("%02x", desc[5]);
+	device->protocol	= intern_printf("%02x", desc[6]);
+	device->maxPacketSize	= desc[7];
+	device->vendorId	= le16(&desc[8]);
+	device->productId	= le16(&desc[10]);
+	device->numConfigs	= desc[17];
+
+	device->revisionNumber	= intern_printf("%02x.%02x", desc[13], desc[12]);
+
+	/* the kernel keeps exactly bNumConfigurations of them */
+	device->config = arena_alloc0(arena, sizeof(struct DeviceConfig *) * device->numConfigs);
+
+	offset = desc[0];
+	while (device->configCount < device->numConfigs && offset < length) {
+		retval = config_parse(arena, device, &desc[offset], length - offset);
+		if (retval <= 0)
+			break;
+		offset += retval;
+	}
+
+	/* only the interfaces of the active configuration are in sysfs */
+	for (configNum = 0; configNum < device->configCount; ++configNum) {
+		struct DeviceConfig *config = device->config[configNum];
+
+		if (config->configNumber != activeConfig)
+			continue;
+
+		config->active = TRUE;
+		for (i = 0; i < config->interfaceCount; ++i)
+			interface_sysfs_parse(device, config,
+					      config->interface[i], dirfd);
+	}
+}
+
+enum {
+	ATTR_BUSNUM,
+	ATTR_DEVNUM,
+	ATTR_SPEED,
+	ATTR_MAXCHILD,
+	ATTR_MANUFACTURER,
+	ATTR_PRODUCT,
+	ATTR_SERIAL,
+	ATTR_CONFIGURATION,
+	ATTR_DESCRIPTORS,
+	ATTR_COUNT
+};
+
+/* also what a --capture saves of every device */
+const char * const usb_device_attributes[ATTR_COUNT + 1] = {
+	[ATTR_BUSNUM]		= "busnum",
+	[ATTR_DEVNUM]		= "devnum",
+	[ATTR_SPEED]		= "speed",
+	[ATTR_MAXCHILD]		= "maxchild",
+	[ATTR_MANUFACTURER]	= "manufacturer",
+	[ATTR_PRODUCT]		= "product",
+	[ATTR_SERIAL]		= "serial",
+	[ATTR_CONFIGURATION]	= "bConfigurationValue",
+	[ATTR_DESCRIPTORS]	= "descriptors",
+	[ATTR_COUNT]		= NULL,
+};
+
+/* Read all of the attributes of the device itself in one batch */
+static void device_attrs_parse(struct arena *arena, struct Device *device, int dirfd)
+{
+	struct sysfs_attr attrs[ATTR_COUNT];
+	char text[ATTR_DESCRIPTORS][256];
+	unsigned char desc[4096];
+	unsigned char *bigDesc;
+	ssize_t length;
+	int i;
+
+	for (i = 0; i < ATTR_COUNT; ++i) {
+		attrs[i].name = usb_device_attributes[i];
+		attrs[i].buffer = (i == ATTR_DESCRIPTORS) ? (char *)desc : text[i];
+		attrs[i].size = (i == ATTR_DESCRIPTORS) ? sizeof(desc) : sizeof(text[i]);
+	}
+
+	sysfs_read_batch(dirfd, attrs, ATTR_COUNT);
+
+	device->busNumber	= sysfs_attr_int(&attrs[ATTR_BUSNUM], 10);
+	device->deviceNumber	= sysfs_attr_int(&attrs[ATTR_DEVNUM], 10);
+	device->handle		= USB_DEVICE_HANDLE(device->busNumber, device->deviceNumber);
+	device->speed		= sysfs_attr_int(&attrs[ATTR_SPEED], 10);
+	device->maxChildren	= sysfs_attr_int(&attrs[ATTR_MAXCHILD], 10);
+	device->manufacturer	= sysfs_attr_string(arena, &attrs[ATTR_MANUFACTURER]);
+	device->product		= sysfs_attr_string(arena, &attrs[ATTR_PRODUCT]);
+	device->serialNumber	= sysfs_attr_string(arena, &attrs[ATTR_SERIAL]);
+
+	length = attrs[ATTR_DESCRIPTORS].length;
+	if (length <= 0)
+		return;
+
+	/* a lot of configurations did not fit, so read the whole thing */
+	if ((size_t)length >= sizeof(desc) - 1) {
+		bigDesc = sysfs_binary(dirfd, "descriptors", &length);
+		if (bigDesc == NULL)
+			return;
+		descriptors_parse(arena, device, dirfd, bigDesc, length,
+				  sysfs_attr_int(&attrs[ATTR_CONFIGURATION], 10));
+		g_free(bigDesc);
+		return;
+	}
+
+	descriptors_parse(arena, device, dirfd, desc, length,
+			  sysfs_attr_int(&attrs[ATTR_CONFIGURATION], 10));
+}
+
+/*
+ * Make room for "count" more devices below a hub.  A hub's list always has
+ * room for all of its ports, and for every device it has, so this only
+ * has to allocate a new list the first time, or if more devices than
+ * ports show up.  The old list then stays behind in the arena.
+ */
+static void device_make_room(struct arena *arena, struct Device *parent, int count)
+{
+	struct Device **child;
+	int room;
+
+	room = parent->child ? MAX(parent->maxChildren, parent->childCount) : 0;
+	if (parent->childCount + count <= room)
+		return;
+
+	child = arena_alloc0(arena, MAX(parent->maxChildren, parent->childCount + count) *
+				    sizeof(struct Device *));
+	if (parent->childCount)
+		memcpy(child, parent->child, parent->childCount * sizeof(struct Device *));
+	parent->child = child;
+}
+
+/* Hook a device up to its hub, which has to have room for it already */
+static void device_add_child(struct Device *parent, struct Device *device)
+{
+	device->parent = parent;
+	parent->child[parent->childCount++] = device;
+}
+
+static int compare_port(const void *a, const void *b)
+{
+	const struct Device *first = *(const struct Device * const *)a;
+	const struct Device *second = *(const struct Device * const *)b;
+
+	return first->portNumber - second->portNumber;
+}
+
+static int compare_bus(const void *a, const void *b)
+{
+	const struct Device *first = *(const struct Device * const *)a;
+	const struct Device *second = *(const struct Device * const *)b;
+
+	return first->busNumber - second->busNumber;
+}
+
+/* show root hubs by bus, and everything else by port */
+static void children_sort(struct Device *parent)
+{
+	if (parent->childCount < 2)
+		return;
+
+	qsort(parent->child, parent->childCount, sizeof(struct Device *),
+	      (parent->parent == NULL) ? compare_bus : compare_port);
+}
+
+/* skip over a number, returns NULL if there is none */
+static const char *skip_number(const char *name)
+{
+	if (!g_ascii_isdigit(*name))
+		return NULL;
+	while (g_ascii_isdigit(*name))
+		++name;
+	return name;
+}
+
+/*
+ * What an entry of /sys/bus/usb/devices is, going by its name alone:
+ * "usb1" is a root hub, "1-1.2" is a device plugged in below it, and
+ * "1-1.2:1.0" is one of that device's interfaces.
+ */
+enum usb_entry {
+	USB_ENTRY_OTHER,
+	USB_ENTRY_ROOT_HUB,
+	USB_ENTRY_DEVICE,
+	USB_ENTRY_INTERFACE,
+};
+
+static enum usb_entry usb_entry_type(const char *name)
+{
+	const char *p;
+
+	if (strncmp(name, "usb", 3) == 0) {
+		p = skip_number(&name[3]);
+		return (p && *p == 0x00) ? USB_ENTRY_ROOT_HUB : USB_ENTRY_OTHER;
+	}
+
+	p = skip_number(name);
+	if (p == NULL || *p != '-')
+		return USB_ENTRY_OTHER;
+	do {
+		p = skip_number(p + 1);
+		if (p == NULL)
+			return USB_ENTRY_OTHER;
+	} while (*p == '.');
+
+	if (*p == 0x00)
+		return USB_ENTRY_DEVICE;
+	if (*p != ':')
+		return USB_ENTRY_OTHER;
+
+	p = skip_number(p + 1);
+	if (p == NULL || *p != '.')
+		return USB_ENTRY_OTHER;
+	p = skip_number(p + 1);
+	return (p && *p == 0x00) ? USB_ENTRY_INTERFACE : USB_ENTRY_OTHER;
+}
+
+/*
+ * Figure out who a device hangs off of from its kernel name:
+ * "1-1.2" lives on "1-1", "1-1" lives on "usb1", and "usb1" is a root hub,
+ * which lives on the root of the tree.  Returns FALSE, with an empty
+ * parentName, for root hubs.
+ */
+static gboolean parent_name(const char *sysfsName, char *parentName, size_t size)
+{
+	const char *dash;
+	char *dot;
+
+	parentName[0] = 0x00;
+	if (strncmp(sysfsName, "usb", 3) == 0)
+		return FALSE;
+
+	dash = strchr(sysfsName, '-');
+	if (dash == NULL)
+		return FALSE;
+
+	g_strlcpy(parentName, sysfsName, size);
+	dot = strrchr(parentName, '.');
+	if (dot != NULL)
+		*dot = 0x00;
+	else
+		snprintf(parentName, size, "usb%.*s",
+			 (int)(dash - sysfsName), sysfsName);
+	return TRUE;
+}
+
+/* Where the device called "sysfsName" is in its hub's list, or -1 */
+static int child_index(const struct Device *parent, const char *sysfsName)
+{
+	int i;
+
+	for (i = 0; i < parent->childCount; ++i) {
+		if (strcmp(parent->child[i]->sysfsName, sysfsName) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Find the device called "sysfsName" in the tree being built, so that it
+ * can be changed.  It, and every hub on the way up to it, is copied into
+ * the new snapshot first if it is still shared with the older one.
+ */
+static struct Device *device_own(struct scan *scan, const char *sysfsName)
+{
+	char parentName[PATH_MAX];
+	struct Device *parent;
+	struct Device *device;
+	int i;
+
+	if (parent_name(sysfsName, parentName, sizeof(parentName)))
+		parent = device_own(scan, parentName);
+	else
+		parent = scan->root;
+	if (parent == NULL)
+		return NULL;
+
+	i = child_index(parent, sysfsName);
+	if (i < 0)
+		return NULL;
+
+	device = parent->child[i];
+	if (device->generation != scan->generation) {
+		device = ShareDevice(scan->arena, device, parent, scan->generation);
+		parent->child[i] = device;
+	}
+	return device;
+}
+
+/* Is "name" the device "top", or one plugged in somewhere below it? */
+static gboolean device_is_below(const char *name, const char *top)
+{
+	size_t len;
+
+	if (strcmp(name, top) == 0)
+		return TRUE;
+
+	/* everything on "usb1" is "1-...", everything on "1-1" is "1-1...." */
+	if (strncmp(top, "usb", 3) == 0) {
+		top += 3;
+		len = strlen(top);
+		return (strncmp(name, top, len) == 0) && (name[len] == '-');
+	}
+
+	len = strlen(top);
+	return (strncmp(name, top, len) == 0) && (name[len] == '.');
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	return strverscmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/*
+ * All of the root hubs and devices are right there in /sys/bus/usb/devices,
+ * so one pass over it finds them all, without probing for anything.  If
+ * "top" is given, only that device and the ones below it are listed.
+ */
+static GPtrArray *devices_list(int dirfd, const char *top)
+{
+	GPtrArray *names;
+	struct dirent *de;
+	DIR *d;
+
+	names = g_ptr_array_new_with_free_func(g_free);
+
+	d = sysfs_list_dir(dirfd);
+	if (!d) {
+		fprintf(stderr, "Can not list %s directory\n", usb_sysfs_devices_dir());
+		return names;
+	}
+
+	while ((de = sysfs_readdir(d))) {
+		switch (usb_entry_type(de->d_name)) {
+		case USB_ENTRY_ROOT_HUB:
+		case USB_ENTRY_DEVICE:
+			if (top == NULL || device_is_below(de->d_name, top))
+				g_ptr_array_add(names, g_strdup(de->d_name));
+			break;
+		case USB_ENTRY_INTERFACE:
+			/* read through the device they belong to */
+		case USB_ENTRY_OTHER:
+			break;
+		}
+	}
+
+	closedir(d);
+
+	/*
+	 * readdir() hands them out in any order.  In "version" order,
+	 * "1-1.2" comes before "1-1.10" and "usb2" before "usb10", so the
+	 * devices on a hub come out in port order, and root hubs in bus order.
+	 */
+	g_ptr_array_sort(names, compare_names);
+	return names;
+}
+
+/*
+ * Read the device called "name" from /sys/bus/usb/devices.  The device's
+ * own directory is only opened once, and everything in it is read relative
+ * to that.  The devices plugged into it are read on their own, and it is
+ * up to the caller to hook it all up into the tree.
+ */
+static struct Device *device_parse(struct scan *scan, int parentfd,
+				   const char *name)
+{
+	struct Device *device;
+	int dirfd;
+
+	dirfd = sysfs_open_dir(parentfd, name);
+	if (dirfd < 0)
+		return NULL;
+
+	device = arena_alloc0(scan->arena, sizeof(struct Device));
+	device->sysfsName = arena_strdup(scan->arena, name);
+	device->generation = scan->generation;
+
+	/* root hubs are level 0, "1-2" is 1, "1-2.3" 2, and so on down */
+	if (usb_entry_type(name) == USB_ENTRY_ROOT_HUB) {
+		device->level = 0;
+	} else {
+		const char *dot;
+
 		device->level = 1;
+		for (dot = strchr(name, '.'); dot != NULL; dot = strchr(dot + 1, '.'))
+			++device->level;
+	}
 
 	int portnum = 0;
 
-	if (parent != rootDevice) {
+	if (device->level != 0) {
 		/*
-		 * The port number is the last number of the file (if present)
-		 * before the '.' or '-' - 1
+		 * The port number is the last number of the name (if present)
+		 * after the '.' or '-' - 1
 		 */
-		const char *temp = &dir[strlen(dir)];
+		const char *temp = &name[strlen(name)];
 
-		while ((*temp != '.') && (*temp != '-'))
+		while ((temp > name) && (*temp != '.') && (*temp != '-'))
 			--temp;
 		temp++;
 		portnum = strtol(temp, NULL, 10) - 1;
@@ -697,79 +1755,615 @@ static void device_parse(struct Device *parent, const char *dir)
 			portnum = 0;
 	}
 	device->portNumber	= portnum;
-	device->busNumber	= sysfs_int(dir, "busnum", 10);
-	device->deviceNumber	= sysfs_int(dir, "devnum", 10);
-	device->speed		= sysfs_int(dir, "speed", 10);
-	device->maxChildren	= sysfs_int(dir, "maxchild", 10);
 
-	device->parent = parent;
+	device_attrs_parse(scan->arena, device, dirfd);
+
+	close(dirfd);
+
+	return device;
+}
+
+static void devices_read(struct scan *scan, int dirfd, GPtrArray *names,
+			 struct Device **devices, guint first, guint count)
+{
+	guint i;
+
+	for (i = first; i < first + count; ++i) {
+		if (g_cancellable_is_cancelled(scan->cancellable))
+			break;
+		devices[i] = device_parse(scan, dirfd, g_ptr_array_index(names, i));
+	}
+}
+
+static void scan_job_run(gpointer data, gpointer user_data)
+{
+	struct scan_job *job = data;
+	struct scan *scan = job->scan;
+
+	devices_read(scan, job->dirfd, job->names, job->devices,
+		     job->first, job->count);
+
+	g_free(job);
+
+	g_mutex_lock(&scan->lock);
+	if (--scan->pending == 0)
+		g_cond_signal(&scan->idle);
+	g_mutex_unlock(&scan->lock);
+}
+
+static void scan_queue(struct scan *scan, int dirfd, GPtrArray *names,
+		       struct Device **devices, guint first, guint count)
+{
+	struct scan_job *job;
+
+	job = g_malloc0(sizeof(*job));
+	job->scan = scan;
+	job->dirfd = dirfd;
+	job->names = names;
+	job->devices = devices;
+	job->first = first;
+	job->count = count;
 
-	if (parent == rootDevice) {
-		++rootDevice->maxChildren;
-		rootDevice->child[rootDevice->maxChildren-1] = device;
+	g_mutex_lock(&scan->lock);
+	++scan->pending;
+	g_mutex_unlock(&scan->lock);
+
+	g_thread_pool_push(scan->pool, job, NULL);
+}
+
+/* Wait for all of the jobs of a scan to be done */
+static void scan_wait(struct scan *scan)
+{
+	g_mutex_lock(&scan->lock);
+	while (scan->pending)
+		g_cond_wait(&scan->idle, &scan->lock);
+	g_mutex_unlock(&scan->lock);
+}
+
+/*
+ * Read all of the devices in "names", spread out over the pool if there is
+ * one, and then hang each of them below its hub.  The hub is either one of
+ * the devices just read, or already in the tree.  Devices whose hub went
+ * away while we were reading are dropped.
+ */
+static void devices_parse(struct scan *scan, int dirfd, GPtrArray *names)
+{
+	char parentName[PATH_MAX];
+	struct Device **devices;
+	struct Device **parents;
+	struct Device *parent;
+	GHashTable *byName;
+	GHashTable *counts;
+	GHashTableIter iter;
+	gpointer key, value;
+	GPtrArray *hubs;
+	gint64 start;
+	guint i;
+
+	start = g_get_monotonic_time();
+	devices = g_new0(struct Device *, names->len);
+
+	if (scan->pool) {
+		for (i = 0; i < names->len; i += SCAN_JOB_DEVICES)
+			scan_queue(scan, dirfd, names, devices, i,
+				   MIN(SCAN_JOB_DEVICES, names->len - i));
+		scan_wait(scan);
 	} else {
-		parent->child[portnum] = device;
+		devices_read(scan, dirfd, names, devices, 0, names->len);
 	}
 
-	device->vendorId	= sysfs_int(dir, "idVendor", 16);
-	device->productId	= sysfs_int(dir, "idProduct", 16);
+	scan->stats->devicesRead += names->len;
+	scan->stats->readTime += g_get_monotonic_time() - start;
+	start = g_get_monotonic_time();
 
-	device->version		= sysfs_string(dir, "version");
-	device->class		= sysfs_string(dir, "bDeviceClass");
-	device->subClass	= sysfs_string(dir, "bDeviceSubClass");
-	device->protocol	= sysfs_string(dir, "bDeviceProtocol");
-	device->maxPacketSize	= sysfs_int(dir, "bMaxPacketSize0", 10);
-	device->numConfigs	= sysfs_int(dir, "bNumConfigurations", 10);
+	hubs = g_ptr_array_new();
+	byName = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < names->len; ++i) {
+		if (devices[i] == NULL)
+			continue;
+		g_hash_table_insert(byName, devices[i]->sysfsName, devices[i]);
+	}
 
-	device->manufacturer	= sysfs_string(dir, "manufacturer");
-	device->product		= sysfs_string(dir, "product");
-	device->serialNumber	= sysfs_string(dir, "serial");
-	char *bcddevice = sysfs_string(dir, "bcdDevice");
+	/*
+	 * Find every device's hub, and count what goes below each of them,
+	 * so that every hub's list only needs to be allocated once.
+	 */
+	parents = g_new0(struct Device *, names->len);
+	counts = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (i = 0; i < names->len; ++i) {
+		if (devices[i] == NULL)
+			continue;
+
+		parent = NULL;
+		if (parent_name(devices[i]->sysfsName, parentName, sizeof(parentName)))
+			parent = g_hash_table_lookup(byName, parentName);
+
+		/* hubs that were in the tree already have to be sorted again too */
+		if (parent == NULL) {
+			if (parentName[0] == 0x00)
+				parent = scan->root;
+			else
+				parent = device_own(scan, parentName);
+			if (parent == NULL)
+				continue;
+			if (!g_ptr_array_find(hubs, parent, NULL))
+				g_ptr_array_add(hubs, parent);
+		}
 
-	device->revisionNumber  = (char *)g_malloc0 ((DEVICE_REVISION_NUMBER_SIZE) * sizeof(char));
-	device->revisionNumber[0] = bcddevice[0];
-	device->revisionNumber[1] = bcddevice[1];
-	device->revisionNumber[2] = '.';
-	device->revisionNumber[3] = bcddevice[2];
-	device->revisionNumber[4] = bcddevice[3];
-	g_free(bcddevice);
+		parents[i] = parent;
+		value = g_hash_table_lookup(counts, parent);
+		g_hash_table_insert(counts, parent,
+				    GUINT_TO_POINTER(GPOINTER_TO_UINT(value) + 1));
+	}
 
-	struct DeviceConfig *config;
+	g_hash_table_iter_init(&iter, counts);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		device_make_room(scan->arena, key, GPOINTER_TO_UINT(value));
 
-	config = g_malloc0(sizeof(struct DeviceConfig));
-	config->maxPower        = sysfs_string(dir, "bMaxPower");
-	config->numInterfaces   = sysfs_int(dir, "bNumInterfaces", 10);
-	config->configNumber	= sysfs_int(dir, "bConfigurationValue", 10);
-	config->attributes	= sysfs_int(dir, "bmAttributes", 16);
+	for (i = 0; i < names->len; ++i) {
+		if (parents[i] != NULL)
+			device_add_child(parents[i], devices[i]);
+	}
 
-	/* have the device now point to this config */
-	device->config[0] = config;
+	/*
+	 * The listing is sorted, so the hubs that were just read got their
+	 * children in port order already.  Only the ones that were in the
+	 * tree before need sorting.
+	 */
+	for (i = 0; i < hubs->len; ++i)
+		children_sort(g_ptr_array_index(hubs, i));
 
-	interfaces_parse(device, dir);
+	g_ptr_array_unref(hubs);
+	g_hash_table_destroy(counts);
+	g_hash_table_destroy(byName);
+	g_free(parents);
+	g_free(devices);
 
-	children_parse(device, dir);
+	scan->stats->linkTime += g_get_monotonic_time() - start;
 }
 
+static int sysfs_open_root(GError **error)
+{
+	int dirfd;
+	int err;
+
+	SCAN_COUNT(USB_SCAN_OPENS);
+	dirfd = open(usb_sysfs_devices_dir(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) {
+		err = errno;
+		g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+			    "%s must be present: %s", usb_sysfs_devices_dir(),
+			    g_strerror(err));
+	}
+	return dirfd;
+}
 
-void sysfs_parse(void)
+/*
+ * The pool is shared by all scans, as only one of them is running at a
+ * time anyway.  Returns NULL if scans should stay on a single thread.
+ */
+static GThreadPool *scan_pool(void)
 {
-	char filename[PATH_MAX];
+	static gsize initialized;
+	static GThreadPool *pool;
+	int threads;
+
+	if (g_once_init_enter(&initialized)) {
+		threads = scanThreads;
+		if (threads <= 0)
+			threads = g_get_num_processors();
+		if (threads > 1)
+			pool = g_thread_pool_new(scan_job_run, NULL, threads,
+						 FALSE, NULL);
+		g_once_init_leave(&initialized, 1);
+	}
+
+	return pool;
+}
+
+/*
+ * Set how many threads a full scan may use to read sysfs.  1 keeps it all
+ * on the scanning thread, 0 uses one thread per processor.  Only has an
+ * effect before the first scan.
+ */
+void usb_set_scan_threads(int threads)
+{
+	scanThreads = threads;
+}
+
+/*
+ * Read the attributes of a device through io_uring, if it was built in
+ * and the kernel lets us.  On by default, turning it off is only good for
+ * seeing how much it helps.
+ */
+void usb_set_scan_uring(gboolean enable)
+{
+	scanUring = enable;
+}
+
+/*
+ * Count the calls to the kernel every scan makes, into the stats of the
+ * snapshot it builds.  Off by default, as it costs a little on every call.
+ */
+void usb_set_scan_stats(gboolean enable)
+{
+	scanStats = enable;
+}
+
+gboolean usb_get_scan_stats(void)
+{
+	return scanStats;
+}
+
+/* the directory with all the USB devices and interfaces, bus/usb/devices */
+const char *usb_sysfs_devices_dir(void)
+{
+	return devicesDir ? devicesDir : USB_DEVICES_DIR;
+}
+
+/*
+ * Read the devices from a sysfs tree mounted somewhere other than /sys,
+ * or a fake one made up for testing.  NULL goes back to /sys.
+ */
+void usb_set_sysfs_root(const char *root)
+{
+	g_free(devicesDir);
+	devicesDir = root ? g_build_filename(root, "bus", "usb", "devices", NULL) : NULL;
+}
+
+/*
+ * Flag buses, and transaction translators, that have more than "percent"
+ * of their periodic bandwidth reserved.
+ */
+void usb_set_bandwidth_threshold(int percent)
+{
+	bandwidthThreshold = percent;
+}
+
+gboolean usb_bandwidth_over(const struct DeviceBandwidth *bandwidth)
+{
+	return bandwidth != NULL && bandwidth->percent > bandwidthThreshold;
+}
+
+/*
+ * Unhook the device at "index" from its hub.  Its memory stays in the
+ * arena it came from until the snapshots using it go away.
+ */
+static void remove_device(struct Device *parent, int index)
+{
+	memmove(&parent->child[index], &parent->child[index + 1],
+		(parent->childCount - index - 1) * sizeof(struct Device *));
+	--parent->childCount;
+}
+
+/*
+ * Re-read a single device (and everything plugged into it), taking the
+ * place of the older copy of it in the tree, or dropping that copy if the
+ * device is gone now.  If the hub it is plugged into is not known yet,
+ * there is nothing to do: the hub's own "add" event will pick this device
+ * up when it comes in.
+ */
+static void device_update(struct scan *scan, int dirfd, const char *sysfsName)
+{
+	char parentName[PATH_MAX];
+	struct Device *parent;
+	GPtrArray *names;
+	gint64 start;
 	int i;
 
-	snprintf(filename, PATH_MAX, "/sys/bus/usb/devices/");
+	if (parent_name(sysfsName, parentName, sizeof(parentName)))
+		parent = device_own(scan, parentName);
+	else
+		parent = scan->root;
+	if (parent == NULL)
+		return;
+
+	/* the old copy is just dropped, whatever is there now takes its place */
+	i = child_index(parent, sysfsName);
+	if (i >= 0)
+		remove_device(parent, i);
+
+	start = g_get_monotonic_time();
+	names = devices_list(dirfd, sysfsName);
+	scan->stats->listTime += g_get_monotonic_time() - start;
+
+	devices_parse(scan, dirfd, names);
+	g_ptr_array_unref(names);
+
+	start = g_get_monotonic_time();
+	i = child_index(parent, sysfsName);
+	if (i >= 0)
+		NameDevice(parent->child[i]);
+	scan->stats->nameTime += g_get_monotonic_time() - start;
+}
+
+/* the periodic budget of every 1ms frame USB 2.0 allows, in us */
+#define FULL_SPEED_BUDGET	900	/* 90% of the frame */
+#define HIGH_SPEED_BUDGET	800	/* 80% of each of its microframes */
 
-	if (check_dir_present(filename)) {
-		fprintf(stderr, "%s must be present, exiting...\n", filename);
+/* one bus, or one transaction translator, while its devices are added up */
+struct bandwidth_sum {
+	long		time;		/* ns of every frame */
+	gint		total;		/* us of every frame, 0 if not in use */
+	gint		interrupts;
+	gint		isocs;
+};
+
+/* what the settings a device is using now reserve */
+static void bandwidth_add(struct bandwidth_sum *sum, const struct Device *device)
+{
+	const struct DeviceConfig *config;
+	const struct DeviceInterface *interface;
+	const struct DeviceEndpoint *endpoint;
+	int i, j, k;
+
+	for (i = 0; i < device->configCount; ++i) {
+		config = device->config[i];
+		if (!config->active)
+			continue;
+		for (j = 0; j < config->interfaceCount; ++j) {
+			interface = config->interface[j];
+			if (!interface->active)
+				continue;
+			for (k = 0; k < interface->endpointCount; ++k) {
+				endpoint = interface->endpoint[k];
+				if (endpoint->busTime == 0)
+					continue;
+				sum->time += endpoint->busTime;
+				if ((endpoint->attribute & USB_ENDPOINT_XFERTYPE_MASK) ==
+				    USB_ENDPOINT_XFER_ISOC)
+					++sum->isocs;
+				else
+					++sum->interrupts;
+			}
+		}
+	}
+}
+
+/*
+ * Add up the periodic bandwidth of everything below "device".  A root hub
+ * has a budget for the devices running at its own speed.  Full and low
+ * speed devices on a high speed bus go through the transaction translator
+ * of the high speed hub they hang off, which has a full speed budget of
+ * its own.  Hubs with more than one translator are counted as if they had
+ * one.  On a root port the host controller does the translating, per port,
+ * so then the budget shows up on the device plugged into it.
+ */
+static void bandwidth_account(struct UsbSnapshot *snapshot, struct Device *device,
+			      struct bandwidth_sum *bus, struct bandwidth_sum *tt)
+{
+	struct bandwidth_sum own;
+	struct DeviceBandwidth *bandwidth;
+	int i;
+
+	memset(&own, 0x00, sizeof(own));
+
+	if (device->level == 0) {
+		bus = NULL;
+		tt = NULL;
+		if (device->speed == 480) {
+			own.total = HIGH_SPEED_BUDGET;
+			bus = &own;
+		} else if (device->speed <= 12) {
+			own.total = FULL_SPEED_BUDGET;
+			bus = &own;
+			tt = &own;
+		}
+	} else if (device->speed == 480 && device->maxChildren) {
+		own.total = FULL_SPEED_BUDGET;
+		tt = &own;
+	} else if (device->speed <= 12 && bus != NULL && tt == NULL) {
+		own.total = FULL_SPEED_BUDGET;
+		tt = &own;
+	}
+
+	/* root hubs are part of the host controller, they reserve nothing */
+	if (device->level > 0) {
+		if (device->speed == 480 && bus != NULL)
+			bandwidth_add(bus, device);
+		else if (device->speed <= 12 && tt != NULL)
+			bandwidth_add(tt, device);
+	}
+
+	for (i = 0; i < device->childCount; ++i)
+		bandwidth_account(snapshot, device->child[i], bus, tt);
+
+	/*
+	 * Nothing below a device shared with an older snapshot changed, so
+	 * what it has is still right, and is not ours to change anyway.
+	 */
+	if (device->generation != snapshot->generation)
+		return;
+
+	device->bandwidth = NULL;
+	if (own.total == 0)
 		return;
+
+	bandwidth = arena_alloc0(snapshot->arena, sizeof(*bandwidth));
+	bandwidth->allocated = (own.time + 999) / 1000;
+	bandwidth->total = own.total;
+	bandwidth->percent = bandwidth->allocated * 100 / own.total;
+	bandwidth->numInterruptRequests = own.interrupts;
+	bandwidth->numIsocRequests = own.isocs;
+	device->bandwidth = bandwidth;
+}
+
+/*
+ * How many snapshots in a row can be built on top of the one before.  The
+ * next one copies the whole tree, so the older snapshots can go away.
+ */
+#define SNAPSHOT_MAX_DEPTH	16
+
+/*
+ * Build a complete, new snapshot of the USB devices.  If an older snapshot
+ * is given, only the devices named in "names" are read from sysfs again,
+ * and everything else is shared with the older one.  Returns NULL, and
+ * sets "error", if there is no sysfs to read the devices from.
+ */
+static struct UsbSnapshot *snapshot_scan(struct UsbSnapshot *old,
+					 GPtrArray *names,
+					 GCancellable *cancellable,
+					 GError **error)
+{
+	struct UsbSnapshot *snapshot;
+	struct UsbScanStats *stats;
+	struct scan scan;
+	GPtrArray *all;
+	gint64 start;
+	gint64 now;
+	int dirfd;
+	guint i;
+
+	start = g_get_monotonic_time();
+	if (scanStats) {
+		for (i = 0; i < USB_SCAN_CALLS; ++i)
+			g_atomic_int_set(&scanCalls[i], 0);
+	}
+
+	snapshot = usb_snapshot_new();
+	stats = &snapshot->stats;
+
+	if (old != NULL && old->depth < SNAPSHOT_MAX_DEPTH) {
+		snapshot->base = usb_snapshot_ref(old);
+		snapshot->depth = old->depth + 1;
+		snapshot->root = ShareDevice(snapshot->arena, old->root, NULL,
+					     snapshot->generation);
+	} else if (old != NULL) {
+		snapshot->root = CopyDevice(snapshot->arena, old->root, NULL,
+					    snapshot->generation);
+	} else {
+		snapshot->root = arena_alloc0(snapshot->arena, sizeof(struct Device));
+		snapshot->root->generation = snapshot->generation;
+	}
+
+	memset(&scan, 0x00, sizeof(scan));
+	scan.root = snapshot->root;
+	scan.arena = snapshot->arena;
+	scan.generation = snapshot->generation;
+	scan.cancellable = cancellable;
+	scan.stats = stats;
+
+	dirfd = sysfs_open_root(error);
+	if (dirfd < 0) {
+		usb_snapshot_unref(snapshot);
+		return NULL;
 	}
 
-	for (i = 1; i < 100; ++i) {
-		snprintf(filename, PATH_MAX, "/sys/bus/usb/devices/usb%d/", i);
-		device_parse(rootDevice, filename);
+	if (old == NULL) {
+		/* only full scans have enough work to be worth spreading out */
+		scan.pool = scan_pool();
+		g_mutex_init(&scan.lock);
+		g_cond_init(&scan.idle);
+
+		now = g_get_monotonic_time();
+		all = devices_list(dirfd, NULL);
+		stats->listTime = g_get_monotonic_time() - now;
+
+		devices_parse(&scan, dirfd, all);
+		g_ptr_array_unref(all);
+
+		g_cond_clear(&scan.idle);
+		g_mutex_clear(&scan.lock);
+
+		now = g_get_monotonic_time();
+		NameDevice(snapshot->root);
+		stats->nameTime = g_get_monotonic_time() - now;
+	} else {
+		for (i = 0; names && i < names->len; ++i)
+			device_update(&scan, dirfd, g_ptr_array_index(names, i));
 	}
+
+	close(dirfd);
+
+	/* any device can change what is left of the budget of its whole bus */
+	for (i = 0; i < (guint)snapshot->root->childCount; ++i)
+		bandwidth_account(snapshot, snapshot->root->child[i], NULL, NULL);
+
+	/* the tree will not change any more, so it can be indexed now */
+	now = g_get_monotonic_time();
+	usb_snapshot_index(snapshot);
+	stats->indexTime = g_get_monotonic_time() - now;
+
+	if (scanStats) {
+		for (i = 0; i < USB_SCAN_CALLS; ++i)
+			stats->calls[i] = g_atomic_int_get(&scanCalls[i]);
+		stats->counted = TRUE;
+	}
+	stats->totalTime = g_get_monotonic_time() - start;
+
+	g_debug("snapshot %u uses %" G_GSIZE_FORMAT " bytes", snapshot->generation,
+		stats->bytes);
+
+	return snapshot;
+}
+
+static void scan_thread(GTask *task, gpointer source, gpointer data,
+			GCancellable *cancellable)
+{
+	struct scan_request *request = data;
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+
+	snapshot = snapshot_scan(request->old, request->names, cancellable, &error);
+	if (snapshot == NULL) {
+		g_task_return_error(task, error);
+		return;
+	}
+
+	if (g_task_return_error_if_cancelled(task)) {
+		usb_snapshot_unref(snapshot);
+		return;
+	}
+
+	g_task_return_pointer(task, snapshot, (GDestroyNotify)usb_snapshot_unref);
 }
 
-void usb_name_devices (void)
+static void scan_request_free(gpointer data)
+{
+	struct scan_request *request = data;
+
+	usb_snapshot_unref(request->old);
+	if (request->names)
+		g_ptr_array_unref(request->names);
+	g_free(request);
+}
+
+/*
+ * Scan the USB devices in a worker thread, and hand back a new snapshot
+ * through usb_snapshot_scan_finish() when done.  Without an old snapshot
+ * everything is read; with one, only the named devices are read again.
+ * Nothing that is passed in is ever changed.
+ */
+void usb_snapshot_scan_async(struct UsbSnapshot *old, GPtrArray *names,
+			     GCancellable *cancellable,
+			     GAsyncReadyCallback callback, gpointer data)
+{
+	struct scan_request *request;
+	GTask *task;
+
+	request = g_malloc0(sizeof(*request));
+	if (old != NULL) {
+		request->old = usb_snapshot_ref(old);
+		request->names = names ? g_ptr_array_ref(names) : NULL;
+	}
+
+	task = g_task_new(NULL, cancellable, callback, data);
+	g_task_set_task_data(task, request, scan_request_free);
+	g_task_run_in_thread(task, scan_thread);
+	g_object_unref(task);
+}
+
+struct UsbSnapshot *usb_snapshot_scan_finish(GAsyncResult *result, GError **error)
+{
+	return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/*
+ * Scan the USB devices right here, on the calling thread, for when there
+ * is no main loop to wait on.  Otherwise the same as the async version.
+ */
+struct UsbSnapshot *usb_snapshot_scan(struct UsbSnapshot *old, GPtrArray *names,
+				      GError **error)
 {
-	NameDevice (rootDevice);
+	return snapshot_scan(old, names, NULL, error);
 }
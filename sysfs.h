@@ -6,57 +6,71 @@
 #ifndef __SYSFS_H
 #define __SYSFS_H
 
-/* should make these dynamic someday... */
-#define MAX_ENDPOINTS				32
-#define MAX_INTERFACES				128
-#define MAX_CONFIGS				32
-#define MAX_CHILDREN				32
-
-#define DEVICE_REVISION_NUMBER_SIZE		6
 #define DEVICE_STRING_MAXSIZE			255
 
 #define INTERFACE_DRIVERNAME_NODRIVER_STRING	"(none)"
-#define INTERFACE_DRIVERNAME_STRING_MAXLENGTH	50
 
 struct DeviceEndpoint {
 	gint		address;
 	gboolean	in;		/* TRUE if in, FALSE if out */
 	gint		attribute;
-	gchar		*type;
+	const gchar	*type;
 	gint		maxPacketSize;
-	gchar		*interval;
+	const gchar	*interval;
+	gint		busTime;	/* ns of every frame it reserves, 0 unless periodic, not saved */
 };
 
 struct DeviceInterface {
-	gchar		*name;
+	const gchar	*name;		/* driver bound to it, interned */
 	gint		interfaceNumber;
 	gint		alternateNumber;
 	gint		numEndpoints;
 	gint		subClass;
 	gint		protocol;
-	gchar		*class;
-	struct DeviceEndpoint *endpoint[MAX_ENDPOINTS];
+	const gchar	*class;
+	struct DeviceEndpoint **endpoint;
+	gint		endpointCount;
 	gboolean	driverAttached;		/* TRUE if driver is attached to this interface currently */
+	gboolean	active;			/* TRUE if this is the alternate setting in use */
 };
 
 struct DeviceConfig {
 	gint		configNumber;
 	gint		numInterfaces;
 	gint		attributes;
-	gchar		*maxPower;
-	struct DeviceInterface *interface[MAX_INTERFACES];
+	const gchar	*maxPower;
+	gboolean	active;		/* TRUE if this is the configuration in use */
+	struct DeviceInterface **interface;	/* every alternate setting of every interface */
+	gint		interfaceCount;
 };
 
+/*
+ * The periodic bandwidth reserved on a root hub's bus, or on the
+ * transaction translator of a high speed hub, by the interrupt and
+ * isochronous endpoints of the settings in use below it.
+ */
 struct DeviceBandwidth {
-	gint		allocated;
-	gint		total;
+	gint		allocated;	/* us of every frame */
+	gint		total;		/* us of every frame USB 2.0 allows for it */
 	gint		percent;
 	gint		numInterruptRequests;
 	gint		numIsocRequests;
 };
 
+/*
+ * A device's bus and address packed into one value, which is what the
+ * tree view keeps to find the device again.  The kernel hands an address
+ * out again once its device is gone, so a handle only stands for the same
+ * device within one snapshot.  Across snapshots, go by the sysfsName for
+ * the port, or the serial number for the device itself.
+ */
+#define USB_DEVICE_HANDLE(busNumber, deviceNumber)	\
+	(((guint64)(guint32)(busNumber) << 32) | (guint32)(deviceNumber))
+
 struct Device {
-	gchar		*name;
+	const gchar	*name;
+	gchar		*sysfsName;	/* kernel name, "usb1", "1-1.2", ... */
+	guint64		handle;		/* USB_DEVICE_HANDLE(busNumber, deviceNumber) */
 	gint		busNumber;
 	gint		level;
 	gint		portNumber;
@@ -64,32 +78,118 @@ struct Device {
 	gint		deviceNumber;
 	gint		speed;
 	gint		maxChildren;
-	gchar		*version;
-	gchar		*class;
-	gchar		*subClass;
-	gchar		*protocol;
+	const gchar	*version;
+	const gchar	*class;
+	const gchar	*subClass;
+	const gchar	*protocol;
 	gint		maxPacketSize;
 	gint		numConfigs;
 	gint		vendorId;
 	gint		productId;
-	gchar		*revisionNumber;
+	const gchar	*revisionNumber;
 	gchar		*manufacturer;
 	gchar		*product;
 	gchar		*serialNumber;
-	struct DeviceConfig *config[MAX_CONFIGS];
-	struct Device	*parent;
-	struct Device	*child[MAX_CHILDREN];
+	struct DeviceConfig **config;
+	gint		configCount;
+	struct Device	*parent;	/* may be its older copy, see struct UsbSnapshot */
+	struct Device	**child;	/* only the ports in use, sorted by port */
+	gint		childCount;
 	struct DeviceBandwidth	*bandwidth;
-	GtkWidget	*tree;
-	GtkTreeIter	leaf;
+	guint64		hash;		/* of all of the above but the children */
+	guint64		subtreeHash;	/* of hash and the subtreeHash of every child */
+	guint		generation;	/* of the snapshot that made it */
+};
+
+struct arena;
+
+/* the calls to the kernel a scan is made of, counted by usb_set_scan_stats() */
+enum UsbScanCall {
+	USB_SCAN_OPENS,
+	USB_SCAN_READS,
+	USB_SCAN_READLINKS,
+	USB_SCAN_DIR_READS,
+	USB_SCAN_CALLS
 };
 
-extern struct Device *rootDevice;
+/*
+ * What building a snapshot took.  The times are in microseconds, and are
+ * all zero for a snapshot loaded from a file.
+ */
+struct UsbScanStats {
+	gint64		listTime;	/* listing bus/usb/devices */
+	gint64		readTime;	/* reading the devices */
+	gint64		linkTime;	/* hanging them into the tree */
+	gint64		nameTime;	/* looking up their names */
+	gint64		indexTime;	/* indexing and hashing the tree */
+	gint64		totalTime;
+	guint		devicesRead;	/* all of them, unless only some changed */
+	gboolean	counted;	/* if calls[] was kept track of */
+	guint		calls[USB_SCAN_CALLS];
+	guint		devices;	/* in the whole tree, root hubs included */
+	guint		interfaces;	/* every alternate setting of every interface */
+	guint		endpoints;
+	gsize		bytes;		/* allocated for the tree */
+};
+
+/*
+ * One complete scan of the USB devices.  Once a snapshot is handed out it
+ * is never changed again, so it can be looked at from any thread for as
+ * long as a reference to it is held.
+ *
+ * A snapshot made from an older one only has its own copies of the
+ * devices that were read again, and of the hubs on the way up to them.
+ * Everything else is shared with the older snapshot, which it holds a
+ * reference to.  The parent of a shared device is whatever copy of its
+ * hub it was made with, so only go by what every copy of the hub has in
+ * common, like its name.
+ */
+struct UsbSnapshot {
+	gint		refCount;
+	guint		generation;	/* goes up by one for every new snapshot */
+	struct Device	*root;		/* the root hubs are its children */
+	struct arena	*arena;		/* its own devices are allocated from here */
+	struct UsbSnapshot *base;	/* the one the other devices are shared with */
+	guint		depth;		/* how many bases there are below it */
+	GHashTable	*byHandle;	/* handle -> device */
+	GHashTable	*byName;	/* sysfsName -> device */
+	GHashTable	*byId;		/* vendorId:productId -> GPtrArray of devices */
+	GHashTable	*bySerial;	/* serialNumber -> GPtrArray of devices */
+	GMappedFile	*file;		/* if loaded from a file, the strings point into it */
+	struct UsbScanStats stats;
+};
+
+guint usb_handle_hash(gconstpointer key);
+struct UsbSnapshot *usb_snapshot_new(void);
+void usb_snapshot_index(struct UsbSnapshot *snapshot);
+struct UsbSnapshot *usb_snapshot_ref(struct UsbSnapshot *snapshot);
+void usb_snapshot_unref(struct UsbSnapshot *snapshot);
+void usb_snapshot_scan_async(struct UsbSnapshot *old, GPtrArray *names,
+			     GCancellable *cancellable,
+			     GAsyncReadyCallback callback, gpointer data);
+struct UsbSnapshot *usb_snapshot_scan_finish(GAsyncResult *result, GError **error);
+struct UsbSnapshot *usb_snapshot_scan(struct UsbSnapshot *old, GPtrArray *names,
+				      GError **error);
+void usb_set_scan_threads(int threads);
+void usb_set_scan_uring(gboolean enable);
+void usb_set_scan_stats(gboolean enable);
+gboolean usb_get_scan_stats(void);
+void usb_set_sysfs_root(const char *root);
+void usb_set_bandwidth_threshold(int percent);
+gboolean usb_bandwidth_over(const struct DeviceBandwidth *bandwidth);
+const char *usb_sysfs_devices_dir(void);
+
+/* the files in sysfs the scan reads for a device, and an interface, NULL ended */
+extern const char * const usb_device_attributes[];
+extern const char * const usb_interface_attributes[];
 
-struct Device *usb_find_device(int deviceNumber, int busNumber);
-void usb_initialize_list(void);
-void sysfs_parse(void);
-void usb_name_devices(void);
+struct Device *usb_find_device(struct UsbSnapshot *snapshot, guint64 handle);
+struct Device *usb_find_device_by_name(struct UsbSnapshot *snapshot,
+				       const char *sysfsName);
+const GPtrArray *usb_find_devices_by_id(struct UsbSnapshot *snapshot,
+					gint vendorId, gint productId);
+const GPtrArray *usb_find_devices_by_serial(struct UsbSnapshot *snapshot,
+					    const char *serialNumber);
 
 #endif	/* __USB_PARSE_H */
 
@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * diff.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Tests of the diff between two scans, of a tree that gets devices
+ * unplugged, plugged in, moved to another port and given a new address
+ * in between.  Ten devices and four ports a hub make this tree:
+ *
+ *	usb1
+ *	  1-1  1-2  1-3                    1-4
+ *	            1-3.1 1-3.2 1-3.3 1-3.4  1-4.1
+ *
+ * so 1-4 has three ports free.
+ */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "diff.h"
+#include "fixture.h"
+
+#define TREE	"-n 10 -f 4"
+
+static const struct UsbDiffEntry *entry(struct UsbDiff *diff, guint i)
+{
+	const struct UsbDiffEntry *entry = g_ptr_array_index(diff->entries, i);
+	gchar *text;
+
+	/* every entry has to be something that can be shown */
+	text = usb_diff_describe(entry);
+	g_assert_nonnull(text);
+	g_free(text);
+
+	return entry;
+}
+
+static void test_same(void)
+{
+	struct UsbSnapshot *before;
+	struct UsbSnapshot *after;
+	struct UsbDiff *diff;
+	gchar *dir;
+
+	dir = fixture_new(TREE);
+	before = fixture_scan(dir);
+	after = fixture_scan(dir);
+
+	diff = usb_diff_new(before, after);
+	g_assert_cmpuint(diff->entries->len, ==, 0);
+	g_assert_cmpuint(diff->skipped, ==, diff->compared);
+
+	usb_diff_free(diff);
+	usb_snapshot_unref(after);
+	usb_snapshot_unref(before);
+	fixture_free(dir);
+}
+
+/* A hub goes away with everything below it, and comes back again */
+static void test_removed_added(void)
+{
+	const struct UsbDiffEntry *removed;
+	const struct UsbDiffEntry *added;
+	struct UsbSnapshot *before;
+	struct UsbSnapshot *after;
+	struct UsbDiff *diff;
+	gchar *dir;
+	guint i;
+
+	dir = fixture_new(TREE);
+	before = fixture_scan(dir);
+	fixture_unplug(dir, "1-3");
+	after = fixture_scan(dir);
+	g_assert_cmpuint(g_hash_table_size(before->byName) - 5, ==,
+			 g_hash_table_size(after->byName));
+
+	diff = usb_diff_new(before, after);
+	g_assert_cmpuint(diff->entries->len, ==, 5);
+	for (i = 0; i < diff->entries->len; ++i) {
+		removed = entry(diff, i);
+		g_assert_cmpuint(removed->flags, ==, USB_DIFF_REMOVED);
+		g_assert_null(removed->newDevice);
+		g_assert_true(g_str_has_prefix(removed->oldDevice->sysfsName, "1-3"));
+	}
+	usb_diff_free(diff);
+
+	diff = usb_diff_new(after, before);
+	g_assert_cmpuint(diff->entries->len, ==, 5);
+	for (i = 0; i < diff->entries->len; ++i) {
+		added = entry(diff, i);
+		g_assert_cmpuint(added->flags, ==, USB_DIFF_ADDED);
+		g_assert_null(added->oldDevice);
+		g_assert_true(g_str_has_prefix(added->newDevice->sysfsName, "1-3"));
+		g_assert_true(usb_diff_lookup(diff, added->newDevice) == added);
+	}
+	usb_diff_free(diff);
+
+	usb_snapshot_unref(after);
+	usb_snapshot_unref(before);
+	fixture_free(dir);
+}
+
+/* The same device on the same port, which the kernel gave a new address */
+static void test_reenumerated(void)
+{
+	const struct UsbDiffEntry *changed;
+	struct UsbSnapshot *before;
+	struct UsbSnapshot *after;
+	struct UsbDiff *diff;
+	gchar *dir;
+
+	dir = fixture_new(TREE);
+	before = fixture_scan(dir);
+	fixture_write(dir, "1-2", "devnum", "99\n", 3);
+	after = fixture_scan(dir);
+
+	diff = usb_diff_new(before, after);
+	g_assert_cmpuint(diff->entries->len, ==, 1);
+	changed = entry(diff, 0);
+	g_assert_cmpuint(changed->flags, ==, USB_DIFF_REENUMERATED);
+	g_assert_cmpstr(changed->oldDevice->sysfsName, ==, "1-2");
+	g_assert_cmpstr(changed->newDevice->sysfsName, ==, "1-2");
+	g_assert_cmpint(changed->newDevice->deviceNumber, ==, 99);
+	g_assert_cmpint(changed->oldDevice->deviceNumber, !=, 99);
+	g_assert_true(usb_diff_lookup(diff, changed->newDevice) == changed);
+
+	usb_diff_free(diff);
+	usb_snapshot_unref(after);
+	usb_snapshot_unref(before);
+	fixture_free(dir);
+}
+
+/* A device with a serial number is unplugged and plugged into another hub */
+static void test_moved(void)
+{
+	const struct UsbDiffEntry *moved;
+	struct UsbSnapshot *before;
+	struct UsbSnapshot *after;
+	struct UsbDiff *diff;
+	gchar *dir;
+
+	dir = fixture_new(TREE);
+	fixture_write(dir, "1-1", "serial", "USBVIEW-TEST\n", 13);
+	before = fixture_scan(dir);
+	fixture_plug(dir, "1-4.3", "1-1");
+	fixture_unplug(dir, "1-1");
+	after = fixture_scan(dir);
+
+	diff = usb_diff_new(before, after);
+	g_assert_cmpuint(diff->entries->len, ==, 1);
+	moved = entry(diff, 0);
+	g_assert_cmpuint(moved->flags & (USB_DIFF_MOVED | USB_DIFF_ADDED | USB_DIFF_REMOVED),
+			 ==, USB_DIFF_MOVED);
+	g_assert_cmpstr(moved->oldDevice->sysfsName, ==, "1-1");
+	g_assert_cmpstr(moved->newDevice->sysfsName, ==, "1-4.3");
+	g_assert_cmpstr(moved->newDevice->serialNumber, ==, "USBVIEW-TEST");
+
+	usb_diff_free(diff);
+	usb_snapshot_unref(after);
+	usb_snapshot_unref(before);
+	fixture_free(dir);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/diff/same", test_same);
+	g_test_add_func("/diff/removed-added", test_removed_added);
+	g_test_add_func("/diff/reenumerated", test_reenumerated);
+	g_test_add_func("/diff/moved", test_moved);
+
+	return g_test_run();
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * fixture.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Made up sysfs trees for the tests to scan.  gensysfs writes them into a
+ * directory of their own, and the tests then change them around: write
+ * other files for a device, unplug it, or plug it in somewhere else.
+ */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "fixture.h"
+
+/*
+ * Write a tree with "gensysfs ARGS DIR" into a new directory.  $GENSYSFS
+ * says where gensysfs is, "make check" points it at the one it built.
+ */
+gchar *fixture_new(const gchar *args)
+{
+	const gchar *gensysfs = g_getenv("GENSYSFS");
+	GError *error = NULL;
+	gchar *command;
+	gchar *output;
+	gchar *quoted[2];
+	gchar *dir;
+	gint status;
+
+	if (gensysfs == NULL)
+		gensysfs = "./gensysfs";
+
+	dir = g_dir_make_tmp("usbview-test-XXXXXX", &error);
+	g_assert_no_error(error);
+
+	quoted[0] = g_shell_quote(gensysfs);
+	quoted[1] = g_shell_quote(dir);
+	command = g_strdup_printf("%s %s %s", quoted[0], args, quoted[1]);
+	g_spawn_command_line_sync(command, &output, NULL, &status, &error);
+	g_assert_no_error(error);
+	g_assert_cmpint(status, ==, 0);
+
+	g_free(output);
+	g_free(command);
+	g_free(quoted[1]);
+	g_free(quoted[0]);
+	return dir;
+}
+
+/* Throw the tree away again */
+void fixture_free(gchar *dir)
+{
+	gchar *argv[] = { "rm", "-rf", dir, NULL };
+	GError *error = NULL;
+	gint status;
+
+	g_spawn_sync(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL,
+		     NULL, NULL, &status, &error);
+	g_assert_no_error(error);
+	g_assert_cmpint(status, ==, 0);
+	g_free(dir);
+}
+
+/* A full scan of the tree, which has to work */
+struct UsbSnapshot *fixture_scan(const gchar *dir)
+{
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+
+	usb_set_sysfs_root(dir);
+	snapshot = usb_snapshot_scan(NULL, NULL, &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(snapshot);
+	return snapshot;
+}
+
+gchar *fixture_read(const gchar *dir, const gchar *name, const gchar *file,
+		    gsize *length)
+{
+	GError *error = NULL;
+	gchar *contents;
+	gchar *path;
+
+	path = g_build_filename(dir, "bus", "usb", "devices", name, file, NULL);
+	g_file_get_contents(path, &contents, length, &error);
+	g_assert_no_error(error);
+	g_free(path);
+	return contents;
+}
+
+/* Replace one of the files of a device, or add it */
+void fixture_write(const gchar *dir, const gchar *name, const gchar *file,
+		   const void *data, gsize length)
+{
+	GError *error = NULL;
+	gchar *path;
+
+	path = g_build_filename(dir, "bus", "usb", "devices", name, file, NULL);
+	g_file_set_contents(path, data, length, &error);
+	g_assert_no_error(error);
+	g_free(path);
+}
+
+/*
+ * Plug in a device called "name", which is the device "like" all over
+ * again.  Its interfaces keep the names they have below "like", which is
+ * fine for everything but their drivers and alternate settings.
+ */
+void fixture_plug(const gchar *dir, const gchar *name, const gchar *like)
+{
+	gchar *path;
+	gchar *link;
+
+	path = g_build_filename(dir, "bus", "usb", "devices", like, NULL);
+	link = g_file_read_link(path, NULL);
+	g_assert_nonnull(link);
+	g_free(path);
+
+	path = g_build_filename(dir, "bus", "usb", "devices", name, NULL);
+	if (symlink(link, path))
+		g_error("can not create %s: %s", path, g_strerror(errno));
+	g_free(path);
+	g_free(link);
+}
+
+/* Unplug a device, along with its interfaces and everything below it */
+void fixture_unplug(const gchar *dir, const gchar *name)
+{
+	const gchar *entry;
+	gchar *devices;
+	gchar *path;
+	gsize length = strlen(name);
+	GDir *list;
+
+	devices = g_build_filename(dir, "bus", "usb", "devices", NULL);
+	list = g_dir_open(devices, 0, NULL);
+	g_assert_nonnull(list);
+
+	while ((entry = g_dir_read_name(list)) != NULL) {
+		if (strncmp(entry, name, length) ||
+		    (entry[length] != '\0' && entry[length] != ':' && entry[length] != '.'))
+			continue;
+
+		path = g_build_filename(devices, entry, NULL);
+		if (g_unlink(path))
+			g_error("can not remove %s: %s", path, g_strerror(errno));
+		g_free(path);
+	}
+
+	g_dir_close(list);
+	g_free(devices);
+}
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * fixture.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ */
+#ifndef __FIXTURE_H
+#define __FIXTURE_H
+
+struct UsbSnapshot;
+
+gchar *fixture_new(const gchar *args);
+void fixture_free(gchar *dir);
+struct UsbSnapshot *fixture_scan(const gchar *dir);
+gchar *fixture_read(const gchar *dir, const gchar *name, const gchar *file,
+		    gsize *length);
+void fixture_write(const gchar *dir, const gchar *name, const gchar *file,
+		   const void *data, gsize length);
+void fixture_plug(const gchar *dir, const gchar *name, const gchar *like);
+void fixture_unplug(const gchar *dir, const gchar *name);
+
+#endif	/* __FIXTURE_H */
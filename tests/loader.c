@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * loader.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Tests of loading a saved snapshot: what is loaded has to be the tree
+ * that was saved, and a file that is cut short, or broken in any other
+ * way, has to give an error, or at least a tree that can be walked and
+ * shown without checking every pointer in it.
+ */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "snapshot.h"
+#include "fixture.h"
+
+/* where things are in a version 1 file, see the structures in snapshot.c */
+#define HEADER_DEVICES		16	/* the offset of the device table */
+#define DEVICE_RECORD		(32 * 4)
+#define DEVICE_NAME		0	/* the fields of a device, 32 bits each */
+#define DEVICE_SYSFS_NAME	1
+#define DEVICE_LEVEL		11
+#define NO_STRING		0xffffffff
+
+/* Save a scan of "dir" into it, and read the file back in */
+static gchar *save(const gchar *dir, gchar **filename, gsize *length)
+{
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+	gchar *contents;
+
+	snapshot = fixture_scan(dir);
+	*filename = g_build_filename(dir, "snapshot", NULL);
+	usb_snapshot_save(snapshot, *filename, &error);
+	g_assert_no_error(error);
+	usb_snapshot_unref(snapshot);
+
+	g_file_get_contents(*filename, &contents, length, &error);
+	g_assert_no_error(error);
+	return contents;
+}
+
+static void set_device(gchar *contents, guint index, guint field, guint32 value)
+{
+	guint32 *table;
+
+	table = (guint32 *)(contents + GUINT32_FROM_LE(*(guint32 *)(contents + HEADER_DEVICES)));
+	table[index * (DEVICE_RECORD / 4) + field] = GUINT32_TO_LE(value);
+}
+
+static guint32 get_device(const gchar *contents, guint index, guint field)
+{
+	const guint32 *table;
+
+	table = (const guint32 *)(contents + GUINT32_FROM_LE(*(guint32 *)(contents + HEADER_DEVICES)));
+	return GUINT32_FROM_LE(table[index * (DEVICE_RECORD / 4) + field]);
+}
+
+/* Write a broken file, which has to be turned down */
+static void load_broken(const gchar *filename, const gchar *contents, gsize length)
+{
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+
+	g_file_set_contents(filename, contents, length, &error);
+	g_assert_no_error(error);
+
+	snapshot = usb_snapshot_load(filename, &error);
+	g_assert_null(snapshot);
+	g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+	g_clear_error(&error);
+}
+
+/* What the tree model, the diff and the dump count on, without checking */
+static void check_tree(const struct Device *device)
+{
+	const struct Device *child;
+	int i;
+
+	for (i = 0; i < device->childCount; ++i) {
+		child = device->child[i];
+		g_assert_nonnull(child);
+		g_assert_true(child->parent == device);
+		g_assert_nonnull(child->name);
+		g_assert_nonnull(child->sysfsName);
+		g_assert_cmpint(child->level, ==, (device->parent == NULL) ? 0 : device->level + 1);
+		g_assert_cmpint(child->level, <=, 6);
+		check_tree(child);
+	}
+}
+
+/* Everything has to be the same, and found the same way */
+static void compare_tree(struct UsbSnapshot *loaded, const struct Device *device)
+{
+	struct Device *other;
+	int i;
+
+	for (i = 0; i < device->childCount; ++i) {
+		other = usb_find_device_by_name(loaded, device->child[i]->sysfsName);
+		g_assert_nonnull(other);
+		g_assert_cmpstr(other->name, ==, device->child[i]->name);
+		g_assert_cmpint(other->level, ==, device->child[i]->level);
+		g_assert_true(usb_find_device(loaded, other->handle) == other);
+		g_assert_cmpuint(other->hash, ==, device->child[i]->hash);
+		compare_tree(loaded, device->child[i]);
+	}
+}
+
+static void test_round_trip(void)
+{
+	struct UsbSnapshot *scanned;
+	struct UsbSnapshot *loaded;
+	GError *error = NULL;
+	gchar *filename;
+	gchar *contents;
+	gsize length;
+	gchar *dir;
+
+	dir = fixture_new("-n 150 -s 5");
+	contents = save(dir, &filename, &length);
+	scanned = fixture_scan(dir);
+
+	loaded = usb_snapshot_load(filename, &error);
+	g_assert_no_error(error);
+	check_tree(loaded->root);
+	compare_tree(loaded, scanned->root);
+	g_assert_cmpuint(g_hash_table_size(loaded->byName), ==,
+			 g_hash_table_size(scanned->byName));
+	g_assert_cmpuint(loaded->stats.interfaces, ==, scanned->stats.interfaces);
+	g_assert_cmpuint(loaded->stats.endpoints, ==, scanned->stats.endpoints);
+	g_assert_cmpuint(loaded->root->subtreeHash, ==, scanned->root->subtreeHash);
+
+	usb_snapshot_unref(loaded);
+	usb_snapshot_unref(scanned);
+	g_free(contents);
+	g_free(filename);
+	fixture_free(dir);
+}
+
+static void test_truncated(void)
+{
+	gchar *filename;
+	gchar *contents;
+	gsize length;
+	gsize cut;
+	gchar *dir;
+
+	dir = fixture_new("-n 10");
+	contents = save(dir, &filename, &length);
+
+	for (cut = 0; cut < length; ++cut)
+		load_broken(filename, contents, cut);
+
+	g_free(contents);
+	g_free(filename);
+	fixture_free(dir);
+}
+
+/* Devices but the root have to have a name to be found and shown by */
+static void test_nameless(void)
+{
+	gchar *filename;
+	gchar *contents;
+	gsize length;
+	gchar *dir;
+	guint field;
+	guint32 value;
+
+	dir = fixture_new("-n 10");
+	contents = save(dir, &filename, &length);
+
+	/* a root hub, and a device plugged into it */
+	for (field = DEVICE_NAME; field <= DEVICE_SYSFS_NAME; ++field) {
+		value = get_device(contents, 1, field);
+		set_device(contents, 1, field, NO_STRING);
+		load_broken(filename, contents, length);
+		set_device(contents, 1, field, value);
+
+		value = get_device(contents, 2, field);
+		set_device(contents, 2, field, NO_STRING);
+		load_broken(filename, contents, length);
+		set_device(contents, 2, field, value);
+	}
+
+	g_free(contents);
+	g_free(filename);
+	fixture_free(dir);
+}
+
+/* Every device is one level below its hub, and the root hubs at level 0 */
+static void test_levels(void)
+{
+	gchar *filename;
+	gchar *contents;
+	gsize length;
+	gchar *dir;
+
+	dir = fixture_new("-n 10");
+	contents = save(dir, &filename, &length);
+
+	g_assert_cmpuint(get_device(contents, 1, DEVICE_LEVEL), ==, 0);
+	set_device(contents, 1, DEVICE_LEVEL, 1);
+	load_broken(filename, contents, length);
+	set_device(contents, 1, DEVICE_LEVEL, 0);
+
+	g_assert_cmpuint(get_device(contents, 2, DEVICE_LEVEL), ==, 1);
+	set_device(contents, 2, DEVICE_LEVEL, 2);
+	load_broken(filename, contents, length);
+	set_device(contents, 2, DEVICE_LEVEL, 0);
+	load_broken(filename, contents, length);
+
+	g_free(contents);
+	g_free(filename);
+	fixture_free(dir);
+}
+
+/*
+ * Two ports on every hub make the seven tiers USB allows out of thirteen
+ * devices, the last two of which are "1-2.2.2.2.2.1" and "1-2.2.2.2.2.2".
+ * Those load fine, one more below them does not.
+ */
+static void test_too_deep(void)
+{
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+	gchar *filename;
+	gchar *contents;
+	gsize length;
+	gchar *dir;
+
+	dir = fixture_new("-n 13 -f 2");
+	contents = save(dir, &filename, &length);
+	snapshot = usb_snapshot_load(filename, &error);
+	g_assert_no_error(error);
+	g_assert_cmpint(usb_find_device_by_name(snapshot, "1-2.2.2.2.2.2")->level, ==, 6);
+	usb_snapshot_unref(snapshot);
+	g_free(contents);
+	g_free(filename);
+
+	fixture_plug(dir, "1-2.2.2.2.2.2.1", "1-1");
+	snapshot = fixture_scan(dir);
+	g_assert_cmpint(usb_find_device_by_name(snapshot, "1-2.2.2.2.2.2.1")->level, ==, 7);
+	usb_snapshot_unref(snapshot);
+
+	contents = save(dir, &filename, &length);
+	load_broken(filename, contents, length);
+
+	g_free(contents);
+	g_free(filename);
+	fixture_free(dir);
+}
+
+/* Flip every byte in turn, whatever still loads has to be a proper tree */
+static void test_corrupted(void)
+{
+	struct UsbSnapshot *snapshot;
+	GError *error = NULL;
+	gchar *filename;
+	gchar *contents;
+	gsize length;
+	gsize i;
+	gchar *dir;
+
+	dir = fixture_new("-n 6 -i 2 -e 2");
+	contents = save(dir, &filename, &length);
+
+	for (i = 0; i < length; ++i) {
+		contents[i] ^= 0x5a;
+		g_file_set_contents(filename, contents, length, &error);
+		g_assert_no_error(error);
+		contents[i] ^= 0x5a;
+
+		snapshot = usb_snapshot_load(filename, &error);
+		if (snapshot == NULL) {
+			g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+			g_clear_error(&error);
+			continue;
+		}
+		check_tree(snapshot->root);
+		usb_snapshot_unref(snapshot);
+	}
+
+	g_free(contents);
+	g_free(filename);
+	fixture_free(dir);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/loader/round-trip", test_round_trip);
+	g_test_add_func("/loader/truncated", test_truncated);
+	g_test_add_func("/loader/nameless", test_nameless);
+	g_test_add_func("/loader/levels", test_levels);
+	g_test_add_func("/loader/too-deep", test_too_deep);
+	g_test_add_func("/loader/corrupted", test_corrupted);
+
+	return g_test_run();
+}
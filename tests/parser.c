@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * parser.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Tests of how the "descriptors" file of a device is taken apart: every
+ * endpoint has to end up in the interface it belongs to, and a file that
+ * is cut short, or has descriptors in it that are too short, must only
+ * lose what is broken, never crash the scan or overrun the lists.
+ */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "sysfs.h"
+#include "fixture.h"
+
+/* the leaf device every test messes with, gensysfs always makes it */
+#define DEVICE	"1-1"
+
+/* Nothing may point outside of what was found, whatever the file said */
+static void check_device(const struct Device *device)
+{
+	int i, j, k;
+
+	g_assert_cmpint(device->configCount, <=, device->numConfigs);
+	for (i = 0; i < device->configCount; ++i) {
+		const struct DeviceConfig *config = device->config[i];
+
+		g_assert_nonnull(config);
+		for (j = 0; j < config->interfaceCount; ++j) {
+			const struct DeviceInterface *interface = config->interface[j];
+
+			g_assert_nonnull(interface);
+			for (k = 0; k < interface->endpointCount; ++k)
+				g_assert_nonnull(interface->endpoint[k]);
+		}
+	}
+}
+
+static void check_tree(const struct Device *device)
+{
+	int i;
+
+	check_device(device);
+	for (i = 0; i < device->childCount; ++i)
+		check_tree(device->child[i]);
+}
+
+/* gensysfs makes every interface with as many endpoints as it says it has */
+static void check_counts(const struct Device *device, guint *endpoints)
+{
+	int i, j;
+
+	for (i = 0; i < device->configCount; ++i) {
+		const struct DeviceConfig *config = device->config[i];
+
+		g_assert_cmpint(config->interfaceCount, >=, config->numInterfaces);
+		for (j = 0; j < config->interfaceCount; ++j) {
+			const struct DeviceInterface *interface = config->interface[j];
+
+			g_assert_cmpint(interface->endpointCount, ==, interface->numEndpoints);
+			*endpoints += interface->endpointCount;
+		}
+	}
+
+	for (i = 0; i < device->childCount; ++i)
+		check_counts(device->child[i], endpoints);
+}
+
+static void test_endpoint_counts(void)
+{
+	struct UsbSnapshot *snapshot;
+	guint endpoints = 0;
+	gchar *dir;
+
+	dir = fixture_new("-n 60 -i 6 -e 4 -s 3");
+	snapshot = fixture_scan(dir);
+
+	check_tree(snapshot->root);
+	check_counts(snapshot->root, &endpoints);
+	g_assert_cmpuint(endpoints, >, 0);
+	g_assert_cmpuint(endpoints, ==, snapshot->stats.endpoints);
+
+	usb_snapshot_unref(snapshot);
+	fixture_free(dir);
+}
+
+/* Cut the file off after every single byte, the rest of the tree must not notice */
+static void test_truncated(void)
+{
+	struct UsbSnapshot *snapshot;
+	struct Device *device;
+	gchar *descriptors;
+	gsize length;
+	gsize cut;
+	guint devices;
+	gchar *dir;
+
+	dir = fixture_new("-n 20 -i 4 -e 3");
+	snapshot = fixture_scan(dir);
+	devices = g_hash_table_size(snapshot->byName);
+	usb_snapshot_unref(snapshot);
+
+	descriptors = fixture_read(dir, DEVICE, "descriptors", &length);
+	for (cut = 0; cut < length; ++cut) {
+		fixture_write(dir, DEVICE, "descriptors", descriptors, cut);
+		snapshot = fixture_scan(dir);
+		g_assert_cmpuint(g_hash_table_size(snapshot->byName), ==, devices);
+		check_tree(snapshot->root);
+
+		device = usb_find_device_by_name(snapshot, DEVICE);
+		g_assert_nonnull(device);
+		if (cut < 18 + 9)
+			g_assert_cmpint(device->configCount, ==, 0);
+
+		usb_snapshot_unref(snapshot);
+	}
+
+	g_free(descriptors);
+	fixture_free(dir);
+}
+
+/* the device descriptor every made up file below starts with */
+static const guchar deviceDescriptor[] = {
+	18, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 64,
+	0x6b, 0x1d, 0x04, 0x01, 0x00, 0x01, 0, 0, 0, 1,
+};
+
+static struct Device *scan_descriptors(gchar *dir, struct UsbSnapshot **snapshot,
+				       guchar *config, gsize length)
+{
+	GByteArray *file;
+	struct Device *device;
+
+	/* the total length of the configuration */
+	config[2] = length & 0xff;
+	config[3] = length >> 8;
+
+	file = g_byte_array_new();
+	g_byte_array_append(file, deviceDescriptor, sizeof(deviceDescriptor));
+	g_byte_array_append(file, config, length);
+	fixture_write(dir, DEVICE, "descriptors", file->data, file->len);
+	g_byte_array_unref(file);
+
+	*snapshot = fixture_scan(dir);
+	device = usb_find_device_by_name(*snapshot, DEVICE);
+	g_assert_nonnull(device);
+	check_device(device);
+	g_assert_cmpint(device->configCount, ==, 1);
+	return device;
+}
+
+/* The endpoints after an interface descriptor that is too short belong to nobody */
+static void test_short_interface(void)
+{
+	guchar config[] = {
+		9, 0x02, 0, 0, 2, 1, 0, 0x80, 50,
+		9, 0x04, 0, 0, 1, 0x03, 0, 0, 0,
+		7, 0x05, 0x81, 0x03, 8, 0, 10,
+		5, 0x04, 1, 0, 3,
+		7, 0x05, 0x82, 0x03, 8, 0, 10,
+		7, 0x05, 0x83, 0x03, 8, 0, 10,
+		7, 0x05, 0x84, 0x03, 8, 0, 10,
+	};
+	struct UsbSnapshot *snapshot;
+	struct DeviceConfig *parsed;
+	struct Device *device;
+	gchar *dir;
+
+	dir = fixture_new("-n 5");
+	device = scan_descriptors(dir, &snapshot, config, sizeof(config));
+
+	parsed = device->config[0];
+	g_assert_cmpint(parsed->interfaceCount, ==, 1);
+	g_assert_cmpint(parsed->interface[0]->endpointCount, ==, 1);
+	g_assert_cmpint(parsed->interface[0]->endpoint[0]->address, ==, 0x81);
+
+	usb_snapshot_unref(snapshot);
+	fixture_free(dir);
+}
+
+/* An endpoint descriptor that is too short is skipped, the next one is kept */
+static void test_short_endpoint(void)
+{
+	guchar config[] = {
+		9, 0x02, 0, 0, 1, 1, 0, 0x80, 50,
+		9, 0x04, 0, 0, 2, 0x03, 0, 0, 0,
+		4, 0x05, 0x81, 0x03,
+		7, 0x05, 0x82, 0x02, 0x00, 0x02, 0,
+		9, 0x04, 0, 1, 1, 0x03, 0, 0, 0,
+		7, 0x05, 0x83, 0x03, 8, 0, 10,
+	};
+	struct UsbSnapshot *snapshot;
+	struct DeviceConfig *parsed;
+	struct Device *device;
+	gchar *dir;
+
+	dir = fixture_new("-n 5");
+	device = scan_descriptors(dir, &snapshot, config, sizeof(config));
+
+	parsed = device->config[0];
+	g_assert_cmpint(parsed->interfaceCount, ==, 2);
+	g_assert_cmpint(parsed->interface[0]->endpointCount, ==, 1);
+	g_assert_cmpint(parsed->interface[0]->endpoint[0]->address, ==, 0x82);
+	g_assert_cmpint(parsed->interface[1]->endpointCount, ==, 1);
+	g_assert_cmpint(parsed->interface[1]->endpoint[0]->address, ==, 0x83);
+
+	usb_snapshot_unref(snapshot);
+	fixture_free(dir);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	/* the scan warns about the broken files these tests are made of */
+	g_log_set_always_fatal(G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL);
+
+	g_test_add_func("/parser/endpoint-counts", test_endpoint_counts);
+	g_test_add_func("/parser/truncated", test_truncated);
+	g_test_add_func("/parser/short-interface", test_short_interface);
+	g_test_add_func("/parser/short-endpoint", test_short_endpoint);
+
+	return g_test_run();
+}
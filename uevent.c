@@ -0,0 +1,330 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * uevent.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * Listen to the kernel's hotplug events for USB devices, so that only the
+ * part of the tree that changed has to be re-read.
+ *
+ * A hub that is power cycled, or a whole rack of them being reset, sends
+ * hundreds of events in a second.  So the events are collected for a
+ * little while first, and everything that happened to a single device
+ * is merged into one re-read of it.  A device that came and went again
+ * in that time is not read at all.  Then the whole lot is handed to the
+ * tree as one update.
+ */
+
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <gtk/gtk.h>
+
+#include "usbtree.h"
+#include "uevent.h"
+
+#define UEVENT_BUFFER_SIZE	8192
+
+/*
+ * How much the kernel may queue up for us.  The default is small enough
+ * that a reset of a few big hubs overflows it before we get to read.
+ */
+#define UEVENT_SOCKET_BUFFER	(8 * 1024 * 1024)
+
+/* how long to collect events for, by default, in milliseconds */
+#define UEVENT_WINDOW		200
+
+enum uevent_action {
+	UEVENT_NONE,
+	UEVENT_ADD,
+	UEVENT_REMOVE,
+};
+
+/*
+ * What happened to a device in the current window.  Only the device
+ * coming and going counts here, not its interfaces, as those can come
+ * and go while the device stays.
+ */
+struct uevent_pending {
+	enum uevent_action	first;
+	enum uevent_action	last;
+};
+
+static guint			window = UEVENT_WINDOW;
+static guint			windowSource;
+static GHashTable		*pending;	/* device name -> struct uevent_pending */
+static struct UsbUeventStats	stats;
+
+struct uevent {
+	const char *action;
+	const char *devpath;
+	const char *subsystem;
+	const char *devtype;
+};
+
+/*
+ * A kernel uevent is "action@devpath" followed by a list of KEY=value
+ * strings, all separated by NUL characters.
+ */
+static int uevent_parse(char *buffer, ssize_t len, struct uevent *event)
+{
+	char *key;
+
+	memset(event, 0x00, sizeof(*event));
+
+	if (strchr(buffer, '@') == NULL)
+		return -EINVAL;
+
+	for (key = buffer + strlen(buffer) + 1; key < buffer + len;
+	     key += strlen(key) + 1) {
+		if (strncmp(key, "ACTION=", 7) == 0)
+			event->action = &key[7];
+		else if (strncmp(key, "DEVPATH=", 8) == 0)
+			event->devpath = &key[8];
+		else if (strncmp(key, "SUBSYSTEM=", 10) == 0)
+			event->subsystem = &key[10];
+		else if (strncmp(key, "DEVTYPE=", 8) == 0)
+			event->devtype = &key[8];
+	}
+
+	if (!event->action || !event->devpath || !event->subsystem)
+		return -EINVAL;
+	return 0;
+}
+
+/* Hand everything that was collected to the tree in one go */
+static gboolean uevent_flush(gpointer data)
+{
+	struct uevent_pending *device;
+	GHashTableIter iter;
+	GPtrArray *names;
+	gpointer name;
+	guint cancelled = 0;
+
+	windowSource = 0;
+
+	names = g_ptr_array_new_with_free_func(g_free);
+	g_hash_table_iter_init(&iter, pending);
+	while (g_hash_table_iter_next(&iter, &name, (gpointer *)&device)) {
+		g_hash_table_iter_steal(&iter);
+
+		/* it came and went before the tree ever got to show it */
+		if ((device->first == UEVENT_ADD) && (device->last == UEVENT_REMOVE)) {
+			g_free(name);
+			++cancelled;
+		} else {
+			g_ptr_array_add(names, name);
+		}
+		g_free(device);
+	}
+
+	stats.cancelled += cancelled;
+	if (names->len) {
+		stats.devices += names->len;
+		++stats.updates;
+		UpdateUSBDevices(names);
+	}
+
+	g_debug("hotplug: %u devices to read, %u came and went; "
+		"%" G_GUINT64_FORMAT " events so far, %" G_GUINT64_FORMAT " updates",
+		names->len, cancelled, stats.received, stats.updates);
+
+	g_ptr_array_unref(names);
+	return G_SOURCE_REMOVE;
+}
+
+static void uevent_queue(const char *name, enum uevent_action action)
+{
+	struct uevent_pending *device;
+
+	if (pending == NULL)
+		pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	device = g_hash_table_lookup(pending, name);
+	if (device == NULL) {
+		device = g_new0(struct uevent_pending, 1);
+		g_hash_table_insert(pending, g_strdup(name), device);
+	} else {
+		++stats.merged;
+	}
+
+	if (action != UEVENT_NONE) {
+		if (device->first == UEVENT_NONE)
+			device->first = action;
+		device->last = action;
+	}
+
+	/* the first event of a window starts it */
+	if (windowSource == 0) {
+		if (window)
+			windowSource = g_timeout_add(window, uevent_flush, NULL);
+		else
+			windowSource = g_idle_add(uevent_flush, NULL);
+	}
+}
+
+static void uevent_handle(struct uevent *event)
+{
+	enum uevent_action action = UEVENT_NONE;
+	char name[PATH_MAX];
+	const char *base;
+	char *colon;
+
+	++stats.received;
+
+	if (strcmp(event->subsystem, "usb") != 0 || event->devtype == NULL) {
+		++stats.ignored;
+		return;
+	}
+
+	base = strrchr(event->devpath, '/');
+	base = base ? base + 1 : event->devpath;
+	g_strlcpy(name, base, sizeof(name));
+
+	if (strcmp(event->devtype, "usb_device") == 0) {
+		/* a removed device is simply gone when it is read again */
+		if (strcmp(event->action, "add") == 0)
+			action = UEVENT_ADD;
+		else if (strcmp(event->action, "remove") == 0)
+			action = UEVENT_REMOVE;
+	} else if (strcmp(event->devtype, "usb_interface") == 0) {
+		/* "1-1.2:1.0" belongs to the "1-1.2" device */
+		colon = strchr(name, ':');
+		if (colon == NULL)
+			return;
+		*colon = 0x00;
+	} else {
+		++stats.ignored;
+		return;
+	}
+
+	if ((strcmp(event->action, "add") == 0) ||
+	    (strcmp(event->action, "remove") == 0) ||
+	    (strcmp(event->action, "bind") == 0) ||
+	    (strcmp(event->action, "unbind") == 0) ||
+	    (strcmp(event->action, "change") == 0))
+		uevent_queue(name, action);
+	else
+		++stats.ignored;
+}
+
+static gboolean uevent_read(GIOChannel *source, GIOCondition condition,
+			    gpointer data)
+{
+	char buffer[UEVENT_BUFFER_SIZE];
+	struct sockaddr_nl addr;
+	socklen_t addrlen;
+	struct uevent event;
+	gboolean lost = FALSE;
+	ssize_t len;
+	int fd = g_io_channel_unix_get_fd(source);
+
+	while (1) {
+		addrlen = sizeof(addr);
+		len = recvfrom(fd, buffer, sizeof(buffer) - 1, 0,
+			       (struct sockaddr *)&addr, &addrlen);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			/* the kernel dropped events, but the socket still works */
+			if (errno == ENOBUFS) {
+				lost = TRUE;
+				continue;
+			}
+			break;
+		}
+
+		/* only trust messages that really came from the kernel */
+		if (addr.nl_pid != 0)
+			continue;
+
+		buffer[len] = 0x00;
+		if (uevent_parse(buffer, len, &event))
+			continue;
+
+		uevent_handle(&event);
+	}
+
+	/*
+	 * There is no telling which devices the lost events were about, so
+	 * read everything again.  That covers whatever was collected so far
+	 * as well.
+	 */
+	if (lost) {
+		++stats.overflows;
+		if (windowSource) {
+			g_source_remove(windowSource);
+			windowSource = 0;
+		}
+		if (pending)
+			g_hash_table_remove_all(pending);
+		g_debug("hotplug: the kernel dropped events, reading all devices again");
+		LoadUSBTree(0);
+	}
+
+	return TRUE;
+}
+
+/*
+ * How long to collect events for before the tree is updated.  With 0,
+ * the events that are read in one go are still merged.
+ */
+void usb_uevent_set_window(guint msecs)
+{
+	window = msecs;
+}
+
+const struct UsbUeventStats *usb_uevent_get_stats(void)
+{
+	return &stats;
+}
+
+int usb_uevent_init(void)
+{
+	struct sockaddr_nl addr;
+	GIOChannel *channel;
+	int size = UEVENT_SOCKET_BUFFER;
+	int retval;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		retval = -errno;
+		fprintf(stderr, "Can not listen for USB hotplug events: %s\n",
+			strerror(-retval));
+		return retval;
+	}
+
+	/* only root may go past net.core.rmem_max, everyone else gets up to it */
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)))
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	memset(&addr, 0x00, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_pid = 0;
+	addr.nl_groups = 1;	/* kernel events, not the udev rebroadcast */
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		retval = -errno;
+		fprintf(stderr, "Can not listen for USB hotplug events: %s\n",
+			strerror(-retval));
+		close(fd);
+		return retval;
+	}
+
+	channel = g_io_channel_unix_new(fd);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	g_io_add_watch(channel, G_IO_IN, uevent_read, NULL);
+	g_io_channel_unref(channel);
+
+	return 0;
+}
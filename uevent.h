@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * uevent.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, greg@kroah.com
+ */
+#ifndef __UEVENT_H
+#define __UEVENT_H
+
+struct UsbUeventStats {
+	guint64		received;	/* all events read from the kernel */
+	guint64		ignored;	/* not about a USB device, or nothing to do */
+	guint64		merged;		/* for a device that had an event already */
+	guint64		cancelled;	/* devices that came and went in one window */
+	guint64		devices;	/* devices handed to the tree to read again */
+	guint64		updates;	/* times the tree was handed any */
+	guint64		overflows;	/* times the kernel dropped events, and all was read again */
+};
+
+int usb_uevent_init(void);
+void usb_uevent_set_window(guint msecs);
+const struct UsbUeventStats *usb_uevent_get_stats(void);
+
+#endif	/* __UEVENT_H */
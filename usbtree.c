@@ -18,188 +18,122 @@
 
 #include "usbtree.h"
 #include "sysfs.h"
+#include "describe.h"
+#include "snapshot.h"
+#include "diff.h"
+#include "uevent.h"
 
 #define MAX_LINE_SIZE	1000
 
+/* the snapshot the tree is showing right now */
+static struct UsbSnapshot	*snapshot;
 
-static void Init (void)
-{
-	GtkTextIter begin;
-	GtkTextIter end;
+/* the file it was loaded from, when it is not showing the live devices */
+static gchar			*snapshotFile;
 
-	/* blow away the tree if there is one */
-	if (rootDevice != NULL) {
-		gtk_tree_store_clear (treeStore);
-	}
+/*
+ * What changed since this snapshot is highlighted.  It is the first one
+ * shown, and is replaced by the next one whenever the tree is refreshed
+ * by hand.
+ */
+static struct UsbSnapshot	*baseline;
+static gboolean			newBaseline;
 
-	/* clean out the text box */
-	gtk_text_buffer_get_start_iter(textDescriptionBuffer,&begin);
-	gtk_text_buffer_get_end_iter(textDescriptionBuffer,&end);
-	gtk_text_buffer_delete (textDescriptionBuffer, &begin, &end);
+/* how long it took to put the snapshot into the tree, in microseconds */
+static gint64			showTime;
 
-	return;
-}
 
+/*
+ * The text of the devices that were shown already, by handle.  It only
+ * holds for the snapshot it was made from, so it is thrown away whenever
+ * a new snapshot comes in.
+ */
+static GHashTable	*descriptionCache;
+static guint		descriptionGeneration;
+
+/* the device to show once the main loop is idle, and if that is queued up */
+static guint64		pendingHandle;
+static guint		pendingDescription;
 
-static void PopulateListBox (int deviceId)
+
+/* Nothing is selected, or it went away, so clean out the text box */
+static void ClearListBox (void)
 {
-	struct Device *device;
-	char    *string;
-	char    *tempString;
-	int     configNum;
-	int     interfaceNum;
-	int     endpointNum;
-	int     deviceNumber = (deviceId >> 8);
-	int     busNumber = (deviceId & 0x00ff);
-	GtkTextIter begin;
-	GtkTextIter end;
-
-	device = usb_find_device (deviceNumber, busNumber);
-	if (device == NULL) {
-		printf ("Can't seem to find device info to display\n");
-		return;
+	if (pendingDescription != 0) {
+		g_source_remove (pendingDescription);
+		pendingDescription = 0;
 	}
 
-	/* clear the textbox */
-	gtk_text_buffer_get_start_iter(textDescriptionBuffer,&begin);
-	gtk_text_buffer_get_end_iter(textDescriptionBuffer,&end);
-	gtk_text_buffer_delete (textDescriptionBuffer, &begin, &end);
-
-	/* freeze the display */
-	/* this keeps the annoying scroll from happening */
-	gtk_widget_freeze_child_notify(textDescriptionView);
+	gtk_text_buffer_set_text (textDescriptionBuffer, "", -1);
+}
 
-	string = (char *)g_malloc (1000);
 
-	/* add the name to the textbox if we have one*/
-	if (device->name != NULL) {
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, device->name,strlen(device->name));
-	}
+static void PopulateListBox (guint64 handle)
+{
+	struct Device *device;
+	const gchar *text;
+	gint64  start;
 
-	/* add the manufacturer if we have one */
-	if (device->manufacturer != NULL) {
-		sprintf (string, "\nManufacturer: %s", device->manufacturer);
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
-	}
+	start = g_get_monotonic_time ();
 
-	/* add the serial number if we have one */
-	if (device->serialNumber != NULL) {
-		sprintf (string, "\nSerial Number: %s", device->serialNumber);
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
+	device = usb_find_device (snapshot, handle);
+	if (device == NULL) {
+		ClearListBox ();
+		return;
 	}
 
-	/* add speed */
-	switch (device->speed) {
-		case 1 :        tempString = "1.5Mb/s (low)";   break;
-		case 12 :       tempString = "12Mb/s (full)";   break;
-		case 480 :      tempString = "480Mb/s (high)";  break;
-		case 5000 :     tempString = "5Gb/s (super)";   break;
-		case 10000 :    tempString = "10Gb/s (super+)"; break;
-		case 20000 :    tempString = "20Gb/s (super+)"; break;
-		default :       tempString = "unknown";         break;
+	if ((descriptionCache == NULL) || (descriptionGeneration != snapshot->generation)) {
+		if (descriptionCache != NULL)
+			g_hash_table_destroy (descriptionCache);
+		descriptionCache = g_hash_table_new_full (usb_handle_hash, g_int64_equal,
+							  g_free, g_free);
+		descriptionGeneration = snapshot->generation;
 	}
-	sprintf (string, "\nSpeed: %s", tempString);
-	gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
-
-	/* Add Bus number */
-	sprintf (string, "\nBus:%4d", busNumber);
-	gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
 
-	/* Add device address */
-	sprintf (string, "\nAddress:%4d", deviceNumber);
-	gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
+	text = g_hash_table_lookup (descriptionCache, &handle);
+	if (text == NULL) {
+		guint64 *key = g_new (guint64, 1);
 
-	/* add ports if available */
-	if (device->maxChildren) {
-		sprintf (string, "\nNumber of Ports: %i", device->maxChildren);
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
+		*key = handle;
+		text = DescribeDevice (device);
+		g_hash_table_insert (descriptionCache, key, (gpointer)text);
 	}
 
-	/* add the bandwidth info if available */
-	if (device->bandwidth != NULL) {
-		sprintf (string, "\nBandwidth allocated: %i / %i (%i%%)", device->bandwidth->allocated, device->bandwidth->total, device->bandwidth->percent);
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
+	/* freeze the display */
+	/* this keeps the annoying scroll from happening */
+	gtk_widget_freeze_child_notify(textDescriptionView);
 
-		sprintf (string, "\nTotal number of interrupt requests: %i", device->bandwidth->numInterruptRequests);
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
+	/* replace everything in the textbox in one go, so it is laid out only once */
+	gtk_text_buffer_set_text (textDescriptionBuffer, text, -1);
 
-		sprintf (string, "\nTotal number of isochronous requests: %i", device->bandwidth->numIsocRequests);
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
-	}
+	/* thaw the display */
+	gtk_widget_thaw_child_notify(textDescriptionView);
 
-	/* add the USB version, device class, subclass, protocol, max packet size, and the number of configurations (if it is there) */
-	if (device->version) {
-		sprintf (string, "\nUSB Version: %s\nDevice Class: %s\nDevice Subclass: %s\nDevice Protocol: %s\n"
-			 "Maximum Default Endpoint Size: %i\nNumber of Configurations: %i",
-			 device->version, device->class, device->subClass, device->protocol,
-			 device->maxPacketSize, device->numConfigs);
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
-	}
+	g_debug ("showing %s took %" G_GINT64_FORMAT " us", device->sysfsName,
+		 g_get_monotonic_time () - start);
 
-	/* add the vendor id, product id, and revision number (if it is there) */
-	if (device->vendorId) {
-		sprintf (string, "\nVendor Id: %.4x\nProduct Id: %.4x\nRevision Number: %s",
-			 device->vendorId, device->productId, device->revisionNumber);
-		gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
-	}
+	return;
+}
 
-	/* display all the info for the configs */
-	for (configNum = 0; configNum < MAX_CONFIGS; ++configNum) {
-		if (device->config[configNum]) {
-			struct DeviceConfig *config = device->config[configNum];
-
-			/* show this config */
-			sprintf (string, "\n\nConfig Number: %i\n\tNumber of Interfaces: %i\n\t"
-				 "Attributes: %.2x\n\tMaxPower Needed: %s",
-				 config->configNumber, config->numInterfaces,
-				 config->attributes, config->maxPower);
-			gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
-
-			/* show all of the interfaces for this config */
-			for (interfaceNum = 0; interfaceNum < MAX_INTERFACES; ++interfaceNum) {
-				if (config->interface[interfaceNum]) {
-					struct DeviceInterface *interface = config->interface[interfaceNum];
-
-					sprintf (string, "\n\n\tInterface Number: %i", interface->interfaceNumber);
-					gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string, strlen(string));
-
-					if (interface->name != NULL) {
-						sprintf (string, "\n\t\tName: %s", interface->name);
-						gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string, strlen(string));
-					}
-
-					sprintf (string, "\n\t\tAlternate Number: %i\n\t\tClass: %s\n\t\t"
-						 "Sub Class: %.2x\n\t\tProtocol: %.2x\n\t\tNumber of Endpoints: %i",
-						 interface->alternateNumber, interface->class,
-						 interface->subClass, interface->protocol, interface->numEndpoints);
-					gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string, strlen(string));
-
-					/* show all of the endpoints for this interface */
-					for (endpointNum = 0; endpointNum < MAX_ENDPOINTS; ++endpointNum) {
-						if (interface->endpoint[endpointNum]) {
-							struct DeviceEndpoint *endpoint = interface->endpoint[endpointNum];
-
-							sprintf (string, "\n\n\t\t\tEndpoint Address: %.2x\n\t\t\t"
-								 "Direction: %s\n\t\t\tAttribute: %i\n\t\t\t"
-								 "Type: %s\n\t\t\tMax Packet Size: %i\n\t\t\tInterval: %s",
-								 endpoint->address,
-								 endpoint->in ? "in" : "out", endpoint->attribute,
-								 endpoint->type, endpoint->maxPacketSize, endpoint->interval);
-							gtk_text_buffer_insert_at_cursor(textDescriptionBuffer, string,strlen(string));
-						}
-					}
-				}
-			}
-		}
-	}
 
-	/* thaw the display */
-	gtk_widget_thaw_child_notify(textDescriptionView);
+static gboolean PopulateListBoxIdle (gpointer data)
+{
+	pendingDescription = 0;
+	PopulateListBox (pendingHandle);
+	return G_SOURCE_REMOVE;
+}
 
-	/* clean up our string */
-	g_free (string);
 
-	return;
+/*
+ * Holding down an arrow key in the tree changes the selection faster than
+ * it can be shown, so only the last device selected before the main loop
+ * gets to be idle is shown.
+ */
+static void QueuePopulateListBox (guint64 handle)
+{
+	pendingHandle = handle;
+	if (pendingDescription == 0)
+		pendingDescription = g_idle_add (PopulateListBoxIdle, NULL);
 }
 
 
@@ -207,93 +141,217 @@ static void SelectItem (GtkTreeSelection *selection, gpointer userData)
 {
 	GtkTreeIter iter;
 	GtkTreeModel *model;
-	gint deviceAddr;
+	guint64 handle;
 
 	if (gtk_tree_selection_get_selected (selection, &model, &iter)) {
 		gtk_tree_model_get (model, &iter,
-				DEVICE_ADDR_COLUMN, &deviceAddr,
+				DEVICE_HANDLE_COLUMN, &handle,
 				-1);
-		PopulateListBox (deviceAddr);
+		QueuePopulateListBox (handle);
+	} else {
+		ClearListBox ();
 	}
 }
 
 
-static void DisplayDevice (struct Device *parent, struct Device *device)
+/* how many rows to open up right away, the rest are opened on demand */
+#define EXPAND_ROWS	500
+
+
+/* Open up a device that just showed up, and everything plugged into it */
+static void ExpandDevice (struct Device *device)
+{
+	GtkTreePath	*path;
+
+	path = usb_tree_model_get_device_path (treeModel, device);
+	gtk_tree_view_expand_to_path (GTK_TREE_VIEW (treeUSB), path);
+	gtk_tree_view_expand_row (GTK_TREE_VIEW (treeUSB), path, TRUE);
+	gtk_tree_path_free (path);
+}
+
+
+/*
+ * Open up the tree level by level, for as long as that shows no more than
+ * EXPAND_ROWS rows.  That is all of it on most machines, but a huge tree
+ * does not have to be walked all the way down just to be shown.
+ */
+static void ExpandTree (struct Device *root)
 {
+	GQueue		queue = G_QUEUE_INIT;
+	struct Device	*device;
+	GtkTreePath	*path;
+	gint		rows = root->childCount;
 	int		i;
-	int		configNum;
-	int		interfaceNum;
-	gboolean	driverAttached = TRUE;
-	gint		deviceAddr;
-	const gchar	*tooltip = NULL;
-	const gchar	*color = NULL;
-
-	if (device == NULL)
-		return;
 
-	/* build this node */
-	deviceAddr = (device->deviceNumber << 8) | device->busNumber;
-	gtk_tree_store_append (treeStore, &device->leaf,
-			       (device->level != 0) ? &parent->leaf : NULL);
-
-	/* determine if this device has drivers attached to all interfaces */
-	for (configNum = 0; configNum < MAX_CONFIGS; ++configNum) {
-		if (device->config[configNum]) {
-			struct DeviceConfig *config = device->config[configNum];
-			for (interfaceNum = 0; interfaceNum < MAX_INTERFACES; ++interfaceNum) {
-				if (config->interface[interfaceNum]) {
-					struct DeviceInterface *interface = config->interface[interfaceNum];
-					if (interface->driverAttached == FALSE) {
-						driverAttached = FALSE;
-						break;
-					}
-				}
-			}
-		}
+	for (i = 0; i < root->childCount; ++i)
+		g_queue_push_tail (&queue, root->child[i]);
+
+	while ((device = g_queue_pop_head (&queue)) != NULL) {
+		if ((device->childCount == 0) ||
+		    (rows + device->childCount > EXPAND_ROWS))
+			continue;
+
+		path = usb_tree_model_get_device_path (treeModel, device);
+		gtk_tree_view_expand_row (GTK_TREE_VIEW (treeUSB), path, FALSE);
+		gtk_tree_path_free (path);
+		rows += device->childCount;
+
+		for (i = 0; i < device->childCount; ++i)
+			g_queue_push_tail (&queue, device->child[i]);
+	}
+}
+
+
+/* the scan running in the background, if any */
+static GCancellable		*scanCancellable;
+
+/* what needs to be scanned again once the running scan is done */
+static gboolean			pendingFullScan;
+static GHashTable		*pendingNames;
+
+static void StartScan (void);
+
+
+/*
+ * Show a new snapshot: patch the tree to match it, then drop the old one.
+ * Only ever called from the main loop, and never while a scan is running.
+ */
+static void ShowSnapshot (struct UsbSnapshot *newSnapshot)
+{
+	struct UsbSnapshot *oldSnapshot = snapshot;
+	GtkTreeSelection *select;
+	GtkTreeModel	*model;
+	GtkTreeIter	iter;
+	GPtrArray	*inserted;
+	guint64		handle;
+	gint64		start;
+	gchar		*text;
+	guint		i;
+
+	start = g_get_monotonic_time ();
+
+	/* only the rows that changed are touched, the rest stay as they are */
+	inserted = usb_tree_model_set_snapshot (treeModel, newSnapshot);
+
+	if ((oldSnapshot == NULL) || (oldSnapshot->root->childCount == 0)) {
+		ExpandTree (newSnapshot->root);
+	} else {
+		for (i = 0; i < inserted->len; ++i)
+			ExpandDevice (g_ptr_array_index (inserted, i));
+	}
+	g_ptr_array_unref (inserted);
+
+	snapshot = newSnapshot;
+	usb_snapshot_unref (oldSnapshot);
+
+	/*
+	 * Highlight everything that came or changed since the tree was first
+	 * shown, or last refreshed.  Devices that went away have no row left
+	 * to mark.
+	 */
+	if ((baseline == NULL) || newBaseline) {
+		usb_snapshot_unref (baseline);
+		baseline = usb_snapshot_ref (newSnapshot);
+		usb_tree_model_set_diff (treeModel, NULL);
+		newBaseline = FALSE;
+	} else {
+		usb_tree_model_set_diff (treeModel, usb_diff_new (baseline, newSnapshot));
 	}
 
-	/* change the color of this leaf if there are no drivers attached to it */
-	if (driverAttached == FALSE) {
-		color = "red";
-		tooltip = "This device has no attached driver";
+	showTime = g_get_monotonic_time () - start;
+	if (usb_get_scan_stats ()) {
+		text = DescribeUSBScan ();
+		g_printerr ("Scan statistics for snapshot %u:\n%s\n", snapshot->generation, text);
+		g_free (text);
 	}
 
-	gtk_tree_store_set (treeStore, &device->leaf,
-			    NAME_COLUMN, device->name,
-			    DEVICE_ADDR_COLUMN, deviceAddr,
-			    COLOR_COLUMN, color,
-			    TOOLTIP_COLUMN, tooltip,
-			    -1);
+	/* the selection survived, so show the fresh info for it */
+	select = gtk_tree_view_get_selection (GTK_TREE_VIEW (treeUSB));
+	if (gtk_tree_selection_get_selected (select, &model, &iter)) {
+		gtk_tree_model_get (model, &iter,
+				DEVICE_HANDLE_COLUMN, &handle,
+				-1);
+		QueuePopulateListBox (handle);
+	} else {
+		ClearListBox ();
+	}
+}
+
 
-	/* create all of the children's leafs */
-	for (i = 0; i < MAX_CHILDREN; ++i) {
-		DisplayDevice (device, device->child[i]);
+static void ScanDone (GObject *source, GAsyncResult *result, gpointer data)
+{
+	struct UsbSnapshot *newSnapshot;
+	GError		*error = NULL;
+
+	g_clear_object (&scanCancellable);
+
+	newSnapshot = usb_snapshot_scan_finish (result, &error);
+	if (newSnapshot != NULL) {
+		ShowSnapshot (newSnapshot);
+	} else {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_printerr ("%s\n", error->message);
+		g_clear_error (&error);
 	}
 
-	return;
+	/* things changed while we were busy, go around again */
+	if (pendingFullScan || g_hash_table_size (pendingNames))
+		StartScan ();
 }
 
 
-void LoadUSBTree (int refresh)
+static void StartScan (void)
 {
-	static gboolean signal_connected = FALSE;
-	int             i;
+	GHashTableIter	iter;
+	GPtrArray	*names = NULL;
+	gpointer	name;
+
+	if (pendingFullScan || (snapshot == NULL)) {
+		g_hash_table_remove_all (pendingNames);
+	} else {
+		names = g_ptr_array_new_with_free_func (g_free);
+		g_hash_table_iter_init (&iter, pendingNames);
+		while (g_hash_table_iter_next (&iter, &name, NULL)) {
+			g_ptr_array_add (names, name);
+			g_hash_table_iter_steal (&iter);
+		}
+	}
+	pendingFullScan = FALSE;
+
+	scanCancellable = g_cancellable_new ();
+	usb_snapshot_scan_async (names ? snapshot : NULL, names,
+				 scanCancellable, ScanDone, NULL);
+	if (names)
+		g_ptr_array_unref (names);
+}
 
-	Init();
 
-	usb_initialize_list ();
+/*
+ * Re-read the devices named after hotplug events, and patch just their
+ * part of the tree instead of rebuilding the whole thing.  If a scan is
+ * running already, they are picked up right after it is done.
+ */
+void UpdateUSBDevices (GPtrArray *sysfsNames)
+{
+	guint	i;
 
-	sysfs_parse();
-	usb_name_devices ();
+	if (pendingNames == NULL)
+		pendingNames = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-	/* build our tree */
-	for (i = 0; i < rootDevice->maxChildren; ++i) {
-		DisplayDevice (rootDevice, rootDevice->child[i]);
-	}
+	for (i = 0; i < sysfsNames->len; ++i)
+		g_hash_table_add (pendingNames, g_strdup (g_ptr_array_index (sysfsNames, i)));
 
-	gtk_widget_show (treeUSB);
+	if (scanCancellable == NULL)
+		StartScan ();
+}
 
-	gtk_tree_view_expand_all (GTK_TREE_VIEW (treeUSB));
+
+/* show the tree, and follow what is selected in it, the first time around */
+static void ConnectTree (void)
+{
+	static gboolean signal_connected = FALSE;
+
+	gtk_widget_show (treeUSB);
 
 	/* hook up our callback function to this tree if we haven't yet */
 	if (!signal_connected) {
@@ -303,10 +361,101 @@ void LoadUSBTree (int refresh)
 				  G_CALLBACK (SelectItem), NULL);
 		signal_connected = TRUE;
 	}
+}
+
+
+/*
+ * Show the devices saved in a snapshot file instead of the live ones.
+ * Refreshing reads the file again, and hotplug events are not followed.
+ */
+gboolean LoadUSBSnapshot (const gchar *filename, GError **error)
+{
+	struct UsbSnapshot *newSnapshot;
+
+	newSnapshot = usb_snapshot_load (filename, error);
+	if (newSnapshot == NULL)
+		return FALSE;
+
+	if (filename != snapshotFile) {
+		g_free (snapshotFile);
+		snapshotFile = g_strdup (filename);
+	}
+
+	ShowSnapshot (newSnapshot);
+	ConnectTree ();
+
+	return TRUE;
+}
+
+
+/*
+ * Scan everything again.  The scan runs in a worker thread, so this never
+ * blocks, and the tree is only touched once a complete new snapshot is
+ * ready.  A scan that is still running is thrown away.  A refresh asked
+ * for by the user also starts the highlighting over from what it finds.
+ */
+void LoadUSBTree (int refresh)
+{
+	GError	*error = NULL;
+
+	if (refresh)
+		newBaseline = TRUE;
+
+	if (snapshotFile != NULL) {
+		if (!LoadUSBSnapshot (snapshotFile, &error)) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+		}
+		return;
+	}
+
+	if (pendingNames == NULL)
+		pendingNames = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	pendingFullScan = TRUE;
+	if (scanCancellable != NULL)
+		g_cancellable_cancel (scanCancellable);
+	else
+		StartScan ();
+
+	ConnectTree ();
 
 	return;
 }
 
+/*
+ * What it took to get the tree that is shown now, and what the hotplug
+ * events since the start added up to, for the "Statistics" dialog.
+ */
+gchar *DescribeUSBScan (void)
+{
+	const struct UsbUeventStats *uevents = usb_uevent_get_stats ();
+	GString	*string;
+	gchar	*text;
+
+	string = g_string_sized_new (1024);
+
+	if (snapshot != NULL) {
+		text = DescribeScanStats (&snapshot->stats);
+		g_string_append_printf (string, "%s\nShowing: %.3f ms\n\n",
+					text, showTime / 1000.0);
+		g_free (text);
+	}
+
+	g_string_append_printf (string, "Hotplug Events: %" G_GUINT64_FORMAT
+				"\nIgnored: %" G_GUINT64_FORMAT
+				"\nMerged: %" G_GUINT64_FORMAT
+				"\nCancelled: %" G_GUINT64_FORMAT
+				"\nDevices Updated: %" G_GUINT64_FORMAT
+				"\nUpdates: %" G_GUINT64_FORMAT
+				"\nOverflows: %" G_GUINT64_FORMAT,
+				uevents->received, uevents->ignored, uevents->merged,
+				uevents->cancelled, uevents->devices, uevents->updates,
+				uevents->overflows);
+
+	return g_string_free (string, FALSE);
+}
+
 void initialize_stuff(void)
 {
 	return;
@@ -6,21 +6,27 @@
 #ifndef __USB_TREE_H
 #define __USB_TREE_H
 
+#include "usbtreemodel.h"
+
 enum {
 	NAME_COLUMN,
-	DEVICE_ADDR_COLUMN,
+	DEVICE_HANDLE_COLUMN,
 	COLOR_COLUMN,
 	TOOLTIP_COLUMN,
+	HIGHLIGHT_COLUMN,
 	N_COLUMNS
 };
 
-extern GtkTreeStore	*treeStore;
+extern UsbTreeModel	*treeModel;
 extern GtkWidget	*treeUSB;
 extern GtkWidget	*textDescriptionView;
 extern GtkTextBuffer	*textDescriptionBuffer;
 extern GtkWidget	*windowMain;
 
 void LoadUSBTree(int refresh);
+gboolean LoadUSBSnapshot(const gchar *filename, GError **error);
+void UpdateUSBDevices(GPtrArray *sysfsNames);
+gchar *DescribeUSBScan(void);
 void initialize_stuff(void);
 GtkWidget *create_windowMain(void);
 
@@ -28,6 +34,7 @@ void on_buttonClose_clicked(GtkButton *button, gpointer user_data);
 gboolean on_window1_delete_event(GtkWidget *widget, GdkEvent *event, gpointer user_data);
 void on_buttonRefresh_clicked(GtkButton *button, gpointer user_data);
 void on_buttonAbout_clicked(GtkButton *button, gpointer user_data);
+void on_buttonStats_clicked(GtkButton *button, gpointer user_data);
 gint on_timer_timeout(gpointer user_data);
 
 #endif	/* __USB_TREE_H */
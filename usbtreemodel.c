@@ -0,0 +1,671 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * usbtreemodel.c for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, <greg@kroah.com>
+ *
+ * A GtkTreeModel that shows a snapshot's device tree as it is, without
+ * copying any of it into a GtkTreeStore.  An iter points right at a
+ * struct Device, and everything in a row is worked out when the view asks
+ * for it.
+ */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "usbtree.h"
+#include "usbtreemodel.h"
+#include "sysfs.h"
+#include "diff.h"
+
+struct _UsbTreeModel {
+	GObject		parent;
+	gint		stamp;
+	struct UsbSnapshot *snapshot;
+	struct Device	*root;		/* the root of what the view is shown */
+
+	/*
+	 * The device every row is shown below.  A device that is shared
+	 * between snapshots can not say which copy of its hub that is.
+	 */
+	GHashTable	*parents;
+
+	/*
+	 * While a new snapshot is going in, the view is shown a mix of the
+	 * old and the new tree.  "working" has the rows shown right now for
+	 * the new devices whose children are being patched.
+	 */
+	GHashTable	*working;
+
+	/* what changed since the tree was first shown or refreshed, or NULL */
+	struct UsbDiff	*diff;
+
+	/* counts of what the last new snapshot had to do to the rows */
+	gint		inserted;
+	gint		removed;
+	gint		changed;
+	gint		unchanged;
+};
+
+struct _UsbTreeModelClass {
+	GObjectClass	parent_class;
+};
+
+static void usb_tree_model_tree_model_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UsbTreeModel, usb_tree_model, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+						usb_tree_model_tree_model_init))
+
+/* The rows shown below a device, or below the top of the tree for NULL */
+static struct Device **model_children (UsbTreeModel *model,
+				       struct Device *device, gint *count)
+{
+	GPtrArray *working;
+
+	/* the old and the new root both stand for the top of the tree */
+	if (device == NULL || device->parent == NULL)
+		device = model->root;
+	if (device == NULL) {
+		*count = 0;
+		return NULL;
+	}
+
+	working = g_hash_table_lookup (model->working, device);
+	if (working != NULL) {
+		*count = working->len;
+		return (struct Device **)working->pdata;
+	}
+
+	*count = device->childCount;
+	return device->child;
+}
+
+/* The device a row is shown below, or NULL for the rows at the top */
+static struct Device *model_parent (UsbTreeModel *model, struct Device *device)
+{
+	struct Device *parent;
+
+	parent = g_hash_table_lookup (model->parents, device);
+	if (parent == NULL || parent->parent == NULL)
+		return NULL;
+	return parent;
+}
+
+static gint model_index (UsbTreeModel *model, struct Device *device)
+{
+	struct Device **child;
+	gint count;
+	gint i;
+
+	child = model_children (model, model_parent (model, device), &count);
+	for (i = 0; i < count; ++i) {
+		if (child[i] == device)
+			return i;
+	}
+	return -1;
+}
+
+static void model_iter (UsbTreeModel *model, GtkTreeIter *iter,
+			struct Device *device, gint index)
+{
+	iter->stamp = model->stamp;
+	iter->user_data = device;
+	iter->user_data2 = GINT_TO_POINTER (index);
+	iter->user_data3 = NULL;
+}
+
+/* determine if this device has drivers attached to all interfaces */
+static gboolean DriversAttached (struct Device *device)
+{
+	int		configNum;
+	int		interfaceNum;
+
+	for (configNum = 0; configNum < device->configCount; ++configNum) {
+		if (device->config[configNum]->active) {
+			struct DeviceConfig *config = device->config[configNum];
+			for (interfaceNum = 0; interfaceNum < config->interfaceCount; ++interfaceNum) {
+				if (config->interface[interfaceNum]->active) {
+					struct DeviceInterface *interface = config->interface[interfaceNum];
+					if (interface->driverAttached == FALSE)
+						return FALSE;
+				}
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static GtkTreeModelFlags usb_tree_model_get_flags (GtkTreeModel *tree_model)
+{
+	return 0;
+}
+
+static gint usb_tree_model_get_n_columns (GtkTreeModel *tree_model)
+{
+	return N_COLUMNS;
+}
+
+static GType usb_tree_model_get_column_type (GtkTreeModel *tree_model, gint column)
+{
+	switch (column) {
+	case DEVICE_HANDLE_COLUMN:
+		return G_TYPE_UINT64;
+	case NAME_COLUMN:
+	case COLOR_COLUMN:
+	case TOOLTIP_COLUMN:
+	case HIGHLIGHT_COLUMN:
+		return G_TYPE_STRING;
+	}
+	return G_TYPE_INVALID;
+}
+
+static gboolean usb_tree_model_get_iter (GtkTreeModel *tree_model,
+					 GtkTreeIter *iter, GtkTreePath *path)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (tree_model);
+	struct Device *device = NULL;
+	struct Device **child;
+	gint *indices;
+	gint depth;
+	gint count;
+	gint i;
+
+	indices = gtk_tree_path_get_indices_with_depth (path, &depth);
+	if (depth == 0)
+		return FALSE;
+
+	for (i = 0; i < depth; ++i) {
+		child = model_children (model, device, &count);
+		if (indices[i] < 0 || indices[i] >= count)
+			return FALSE;
+		device = child[indices[i]];
+	}
+
+	model_iter (model, iter, device, indices[depth - 1]);
+	return TRUE;
+}
+
+static GtkTreePath *usb_tree_model_get_path (GtkTreeModel *tree_model,
+					     GtkTreeIter *iter)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (tree_model);
+	struct Device *device = iter->user_data;
+	GtkTreePath *path;
+
+	g_return_val_if_fail (iter->stamp == model->stamp, NULL);
+
+	path = gtk_tree_path_new ();
+	while (device != NULL) {
+		gtk_tree_path_prepend_index (path, model_index (model, device));
+		device = model_parent (model, device);
+	}
+	return path;
+}
+
+/* What the diff has to say about a device, if it is from the tree being shown */
+static const struct UsbDiffEntry *model_diff_entry (UsbTreeModel *model,
+						    struct Device *device)
+{
+	if ((model->diff == NULL) || (model->diff->newSnapshot != model->snapshot))
+		return NULL;
+	return usb_diff_lookup (model->diff, device);
+}
+
+static void usb_tree_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter,
+				      gint column, GValue *value)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (tree_model);
+	struct Device *device = iter->user_data;
+	const struct UsbDiffEntry *entry;
+
+	g_return_if_fail (iter->stamp == model->stamp);
+
+	g_value_init (value, usb_tree_model_get_column_type (tree_model, column));
+
+	switch (column) {
+	case NAME_COLUMN:
+		g_value_set_static_string (value, device->name);
+		break;
+	case DEVICE_HANDLE_COLUMN:
+		g_value_set_uint64 (value, device->handle);
+		break;
+	case COLOR_COLUMN:
+		/* change the color of this leaf if there are no drivers attached to it */
+		if (!DriversAttached (device))
+			g_value_set_static_string (value, "red");
+		break;
+	case TOOLTIP_COLUMN:
+		entry = model_diff_entry (model, device);
+		if (usb_bandwidth_over (device->bandwidth))
+			g_value_take_string (value, g_strdup_printf (
+				"%d%% of the periodic bandwidth is taken",
+				device->bandwidth->percent));
+		else if (entry != NULL)
+			g_value_take_string (value, usb_diff_describe (entry));
+		else if (!DriversAttached (device))
+			g_value_set_static_string (value, "This device has no attached driver");
+		break;
+	case HIGHLIGHT_COLUMN:
+		/* buses short on bandwidth are red, that matters most */
+		if (usb_bandwidth_over (device->bandwidth)) {
+			g_value_set_static_string (value, "#f8c8c8");
+			break;
+		}
+
+		/* devices that showed up are green, ones that changed are yellow */
+		entry = model_diff_entry (model, device);
+		if (entry == NULL)
+			break;
+		if (entry->flags & USB_DIFF_ADDED)
+			g_value_set_static_string (value, "#c8f0c8");
+		else
+			g_value_set_static_string (value, "#f8ecb0");
+		break;
+	}
+}
+
+static gboolean usb_tree_model_iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (tree_model);
+	struct Device *device = iter->user_data;
+	struct Device **child;
+	gint index = GPOINTER_TO_INT (iter->user_data2) + 1;
+	gint count;
+
+	child = model_children (model, model_parent (model, device), &count);
+	if (index >= count) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	model_iter (model, iter, child[index], index);
+	return TRUE;
+}
+
+static gboolean usb_tree_model_iter_previous (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (tree_model);
+	struct Device *device = iter->user_data;
+	struct Device **child;
+	gint index = GPOINTER_TO_INT (iter->user_data2) - 1;
+	gint count;
+
+	child = model_children (model, model_parent (model, device), &count);
+	if (index < 0 || index >= count) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	model_iter (model, iter, child[index], index);
+	return TRUE;
+}
+
+static gboolean usb_tree_model_iter_nth_child (GtkTreeModel *tree_model,
+					       GtkTreeIter *iter,
+					       GtkTreeIter *parent, gint n)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (tree_model);
+	struct Device **child;
+	gint count;
+
+	child = model_children (model, parent ? parent->user_data : NULL, &count);
+	if (n < 0 || n >= count) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	model_iter (model, iter, child[n], n);
+	return TRUE;
+}
+
+static gboolean usb_tree_model_iter_children (GtkTreeModel *tree_model,
+					      GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	return usb_tree_model_iter_nth_child (tree_model, iter, parent, 0);
+}
+
+static gint usb_tree_model_iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (tree_model);
+	gint count;
+
+	model_children (model, iter ? iter->user_data : NULL, &count);
+	return count;
+}
+
+static gboolean usb_tree_model_iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return usb_tree_model_iter_n_children (tree_model, iter) > 0;
+}
+
+static gboolean usb_tree_model_iter_parent (GtkTreeModel *tree_model,
+					    GtkTreeIter *iter, GtkTreeIter *child)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (tree_model);
+	struct Device *parent;
+
+	parent = model_parent (model, child->user_data);
+	if (parent == NULL) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	model_iter (model, iter, parent, model_index (model, parent));
+	return TRUE;
+}
+
+static void usb_tree_model_tree_model_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags = usb_tree_model_get_flags;
+	iface->get_n_columns = usb_tree_model_get_n_columns;
+	iface->get_column_type = usb_tree_model_get_column_type;
+	iface->get_iter = usb_tree_model_get_iter;
+	iface->get_path = usb_tree_model_get_path;
+	iface->get_value = usb_tree_model_get_value;
+	iface->iter_next = usb_tree_model_iter_next;
+	iface->iter_previous = usb_tree_model_iter_previous;
+	iface->iter_children = usb_tree_model_iter_children;
+	iface->iter_has_child = usb_tree_model_iter_has_child;
+	iface->iter_n_children = usb_tree_model_iter_n_children;
+	iface->iter_nth_child = usb_tree_model_iter_nth_child;
+	iface->iter_parent = usb_tree_model_iter_parent;
+}
+
+static void usb_tree_model_finalize (GObject *object)
+{
+	UsbTreeModel *model = USB_TREE_MODEL (object);
+
+	if (model->diff != NULL)
+		usb_diff_free (model->diff);
+	usb_snapshot_unref (model->snapshot);
+	g_hash_table_destroy (model->parents);
+	g_hash_table_destroy (model->working);
+
+	G_OBJECT_CLASS (usb_tree_model_parent_class)->finalize (object);
+}
+
+static void usb_tree_model_class_init (UsbTreeModelClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = usb_tree_model_finalize;
+}
+
+static void usb_tree_model_init (UsbTreeModel *model)
+{
+	model->stamp = g_random_int ();
+	model->parents = g_hash_table_new (g_direct_hash, g_direct_equal);
+	model->working = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+						(GDestroyNotify)g_ptr_array_unref);
+}
+
+UsbTreeModel *usb_tree_model_new (void)
+{
+	return g_object_new (USB_TYPE_TREE_MODEL, NULL);
+}
+
+/* The share of the periodic bandwidth the tooltip shows, 0 if none is kept track of */
+static gint BandwidthPercent (const struct Device *device)
+{
+	return (device->bandwidth != NULL) ? device->bandwidth->percent : 0;
+}
+
+/* Is anything that is shown in the row different between the two copies? */
+static gboolean RowChanged (struct Device *oldDevice, struct Device *newDevice)
+{
+	return (g_strcmp0 (oldDevice->name, newDevice->name) != 0) ||
+	       (oldDevice->handle != newDevice->handle) ||
+	       (DriversAttached (oldDevice) != DriversAttached (newDevice)) ||
+	       (usb_bandwidth_over (oldDevice->bandwidth) !=
+		usb_bandwidth_over (newDevice->bandwidth)) ||
+	       (BandwidthPercent (oldDevice) != BandwidthPercent (newDevice));
+}
+
+/* Remember where a new row, and all of the rows below it, are shown */
+static void RowsAdd (UsbTreeModel *model, struct Device *parent, struct Device *device)
+{
+	gint i;
+
+	g_hash_table_insert (model->parents, device, parent);
+	for (i = 0; i < device->childCount; ++i)
+		RowsAdd (model, device, device->child[i]);
+}
+
+/* Forget a row that is gone, and all of the rows that were below it */
+static void RowsRemove (UsbTreeModel *model, struct Device *device)
+{
+	gint i;
+
+	g_hash_table_remove (model->parents, device);
+	for (i = 0; i < device->childCount; ++i)
+		RowsRemove (model, device->child[i]);
+}
+
+/*
+ * Start patching the rows below a device.  Until that is done, they are
+ * still the children of its old copy, if it has one.
+ */
+static void WorkingInit (UsbTreeModel *model, struct Device *oldParent,
+			 struct Device *newParent)
+{
+	GPtrArray *working;
+	gint i;
+
+	working = g_ptr_array_sized_new (MAX (oldParent ? oldParent->childCount : 0,
+					      newParent->childCount));
+	for (i = 0; oldParent && i < oldParent->childCount; ++i) {
+		g_ptr_array_add (working, oldParent->child[i]);
+		g_hash_table_insert (model->parents, oldParent->child[i], newParent);
+	}
+
+	g_hash_table_insert (model->working, newParent, working);
+}
+
+static void WorkingDone (UsbTreeModel *model, struct Device *newParent)
+{
+	g_hash_table_remove (model->working, newParent);
+}
+
+static struct Device *FindChild (struct Device *parent, const gchar *sysfsName)
+{
+	int		i;
+
+	for (i = 0; parent && i < parent->childCount; ++i) {
+		if (strcmp (parent->child[i]->sysfsName, sysfsName) == 0)
+			return parent->child[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Turn the rows below a device from its old children into its new ones,
+ * matching them up by their kernel name (bus number plus port path).  The
+ * view is told about every single step, and at every step the model shows
+ * just what the view was told so far.  Rows of devices that are still
+ * there are kept, and only reported as changed if something shown in
+ * them changed.
+ */
+static void ReconcileChildren (UsbTreeModel *model, GtkTreePath *path,
+			       struct Device *oldParent, struct Device *newParent,
+			       GPtrArray *inserted)
+{
+	GPtrArray	*working;
+	struct Device	*oldDevice;
+	struct Device	*newDevice;
+	GtkTreeIter	iter;
+	guint		i;
+
+	working = g_hash_table_lookup (model->working, newParent);
+
+	/* first drop everything that is gone */
+	for (i = 0; i < working->len; ) {
+		oldDevice = g_ptr_array_index (working, i);
+		if (FindChild (newParent, oldDevice->sysfsName) != NULL) {
+			++i;
+			continue;
+		}
+
+		g_ptr_array_remove_index (working, i);
+		RowsRemove (model, oldDevice);
+		++model->stamp;
+		gtk_tree_path_append_index (path, i);
+		gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+		gtk_tree_path_up (path);
+		++model->removed;
+	}
+
+	/*
+	 * Then walk the new children in order, patching or adding rows.  The
+	 * ones left are in port order just like the new ones, so each new
+	 * child is either the row that is there already, or goes in before it.
+	 */
+	for (i = 0; i < (guint)newParent->childCount; ++i) {
+		newDevice = newParent->child[i];
+		oldDevice = (i < working->len) ? g_ptr_array_index (working, i) : NULL;
+
+		gtk_tree_path_append_index (path, i);
+
+		if (oldDevice == newDevice) {
+			/* shared by both snapshots, so nothing below it changed */
+			g_hash_table_insert (model->parents, newDevice, newParent);
+			++model->unchanged;
+		} else if ((oldDevice != NULL) &&
+			   (strcmp (oldDevice->sysfsName, newDevice->sysfsName) == 0)) {
+			working->pdata[i] = newDevice;
+			g_hash_table_remove (model->parents, oldDevice);
+			g_hash_table_insert (model->parents, newDevice, newParent);
+			WorkingInit (model, oldDevice, newDevice);
+
+			if (RowChanged (oldDevice, newDevice)) {
+				model_iter (model, &iter, newDevice, i);
+				gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+				++model->changed;
+			} else {
+				++model->unchanged;
+			}
+
+			ReconcileChildren (model, path, oldDevice, newDevice, inserted);
+			WorkingDone (model, newDevice);
+
+			/* let the view know when the expander has to come or go */
+			if ((oldDevice->childCount == 0) != (newDevice->childCount == 0)) {
+				model_iter (model, &iter, newDevice, i);
+				gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
+								      path, &iter);
+			}
+		} else {
+			g_ptr_array_insert (working, i, newDevice);
+			RowsAdd (model, newParent, newDevice);
+			++model->stamp;
+			model_iter (model, &iter, newDevice, i);
+			gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+			if (newDevice->childCount)
+				gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
+								      path, &iter);
+			g_ptr_array_add (inserted, newDevice);
+			++model->inserted;
+		}
+
+		gtk_tree_path_up (path);
+	}
+}
+
+/*
+ * Show a new snapshot.  Only the rows of devices that came, went or
+ * changed are reported to the view.  Every row is matched up with its
+ * new copy, whether the view has it expanded or not, but a device both
+ * snapshots share is left alone, along with everything below it.
+ * Returns the devices that got new rows, the topmost ones only.
+ */
+GPtrArray *usb_tree_model_set_snapshot (UsbTreeModel *model,
+					struct UsbSnapshot *snapshot)
+{
+	struct UsbSnapshot *oldSnapshot = model->snapshot;
+	struct Device *oldRoot = oldSnapshot ? oldSnapshot->root : NULL;
+	GPtrArray *inserted;
+	GtkTreePath *path;
+
+	g_return_val_if_fail (USB_IS_TREE_MODEL (model), NULL);
+
+	model->inserted = model->removed = 0;
+	model->changed = model->unchanged = 0;
+
+	inserted = g_ptr_array_new ();
+	path = gtk_tree_path_new ();
+
+	model->snapshot = usb_snapshot_ref (snapshot);
+	model->root = snapshot->root;
+
+	WorkingInit (model, oldRoot, snapshot->root);
+	ReconcileChildren (model, path, oldRoot, snapshot->root, inserted);
+	WorkingDone (model, snapshot->root);
+
+	gtk_tree_path_free (path);
+	usb_snapshot_unref (oldSnapshot);
+
+	g_debug ("tree refresh: %d rows inserted, %d removed, %d changed, %d unchanged",
+		 model->inserted, model->removed, model->changed, model->unchanged);
+
+	return inserted;
+}
+
+/* Tell the view to draw the row of a device in the current snapshot again */
+static void RowRedraw (UsbTreeModel *model, const gchar *sysfsName)
+{
+	struct Device *device;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	device = usb_find_device_by_name (model->snapshot, sysfsName);
+	if (device == NULL)
+		return;
+
+	model_iter (model, &iter, device, model_index (model, device));
+	path = usb_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
+	gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+/*
+ * Highlight what a diff found in the snapshot being shown.  The model
+ * takes the diff over, and drops the one it had before.  Only the rows
+ * that were highlighted before, or are now, are drawn again.
+ */
+void usb_tree_model_set_diff (UsbTreeModel *model, struct UsbDiff *diff)
+{
+	struct UsbDiff *oldDiff = model->diff;
+	struct UsbDiffEntry *entry;
+	guint i;
+
+	g_return_if_fail (USB_IS_TREE_MODEL (model));
+
+	model->diff = diff;
+
+	for (i = 0; oldDiff && model->snapshot && i < oldDiff->entries->len; ++i) {
+		entry = g_ptr_array_index (oldDiff->entries, i);
+		if (entry->newDevice != NULL)
+			RowRedraw (model, entry->newDevice->sysfsName);
+	}
+	for (i = 0; diff && model->snapshot && i < diff->entries->len; ++i) {
+		entry = g_ptr_array_index (diff->entries, i);
+		if (entry->newDevice != NULL)
+			RowRedraw (model, entry->newDevice->sysfsName);
+	}
+
+	if (oldDiff != NULL)
+		usb_diff_free (oldDiff);
+}
+
+GtkTreePath *usb_tree_model_get_device_path (UsbTreeModel *model,
+					    struct Device *device)
+{
+	GtkTreeIter iter;
+
+	model_iter (model, &iter, device, model_index (model, device));
+	return usb_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
+}
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * usbtreemodel.h for USBView - a USB device viewer
+ * Copyright (c) 2026 by Greg Kroah-Hartman, greg@kroah.com
+ */
+#ifndef __USB_TREE_MODEL_H
+#define __USB_TREE_MODEL_H
+
+struct Device;
+struct UsbSnapshot;
+struct UsbDiff;
+
+#define USB_TYPE_TREE_MODEL		(usb_tree_model_get_type ())
+#define USB_TREE_MODEL(obj)		(G_TYPE_CHECK_INSTANCE_CAST ((obj), USB_TYPE_TREE_MODEL, UsbTreeModel))
+#define USB_IS_TREE_MODEL(obj)		(G_TYPE_CHECK_INSTANCE_TYPE ((obj), USB_TYPE_TREE_MODEL))
+
+typedef struct _UsbTreeModel		UsbTreeModel;
+typedef struct _UsbTreeModelClass	UsbTreeModelClass;
+
+GType usb_tree_model_get_type(void);
+UsbTreeModel *usb_tree_model_new(void);
+GPtrArray *usb_tree_model_set_snapshot(UsbTreeModel *model,
+				       struct UsbSnapshot *snapshot);
+void usb_tree_model_set_diff(UsbTreeModel *model, struct UsbDiff *diff);
+GtkTreePath *usb_tree_model_get_device_path(UsbTreeModel *model,
+					    struct Device *device);
+
+#endif	/* __USB_TREE_MODEL_H */